@@ -1,13 +1,368 @@
 #include "crow.h"
 #include "src/image_processing.hpp"
+#include "src/pipeline.hpp"
+#include "src/opencv_interop.hpp"
+#include "src/session_store.hpp"
+#include "src/metrics.hpp"
+#include "src/result_cache.hpp"
+#include "src/pyramid.hpp"
+#include "src/compute_pool.hpp"
 #include <opencv2/opencv.hpp>
-#include <fstream>
-#include <filesystem>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
+
+
+// Decoded images by upload ID; see session_store.hpp. IMAGE_STORE_MB sets the budget.
+SessionStore sessions;
+
+// Results shared across sessions by content key: encoded outputs for /getImage
+// (IMAGE_RESULT_CACHE_MB, default 128) and, optionally, decoded images so a
+// repeated upload or edit is a copy (IMAGE_PIXEL_CACHE_MB, default 0 = off)
+EncodedCache encodedCache(cacheBudgetFromEnvironment("IMAGE_RESULT_CACHE_MB", 128));
+PixelCache pixelCache(cacheBudgetFromEnvironment("IMAGE_PIXEL_CACHE_MB", 0));
+
+// Requests that do image work run here rather than on Crow's I/O threads
+// (IMAGE_COMPUTE_THREADS, default 2; IMAGE_COMPUTE_QUEUE waiting, default 64)
+// and are abandoned after IMAGE_DEADLINE_MS (default 30000), see offload()
+ComputePool computePool;
+const int deadlineMs = [] {
+    const char* value = std::getenv("IMAGE_DEADLINE_MS");
+    return value ? std::max(1, std::atoi(value)) : 30000;
+}();
+Counter& deadlinesExceeded = MetricsRegistry::global().counter(
+    "image_deadline_exceeded_total", "Requests abandoned because their deadline passed");
+
+// Uploads larger than IMAGE_MAX_UPLOAD_MB (default 50) are refused with 413
+// before any copy or decode; decoded dimensions are capped by DecodeLimits
+// (IMAGE_MAX_PIXELS, IMAGE_MAX_DIMENSION), checked against the image header
+const size_t maxUploadBytes = cacheBudgetFromEnvironment("IMAGE_MAX_UPLOAD_MB", 50);
+const DecodeLimits decodeLimits = DecodeLimits::fromEnvironment();
+
+// Requests without ?id= get 400. IMAGE_LEGACY_LATEST_ID=1 makes them act on
+// the most recent upload instead, as the single-image API used to; with
+// several clients that edits whichever image was uploaded last.
+const bool legacyLatestId = [] {
+    const char* value = std::getenv("IMAGE_LEGACY_LATEST_ID");
+    return value && std::atoi(value) != 0;
+}();
+std::mutex latestUploadMutex;
+std::string latestUploadId;
+
+// Throws invalid_argument when the request names no image
+std::string sessionId(const crow::request& req) {
+    if (const char* id = req.url_params.get("id")) return id;
+    if (!legacyLatestId) throw std::invalid_argument("Missing ?id= of the uploaded image.");
+    std::lock_guard<std::mutex> lock(latestUploadMutex);
+    return latestUploadId;
+}
+
+// Latency histograms and counters for one route. All of them are created at
+// startup, so a request only looks them up in a read-only map and bumps atomics.
+struct RouteMetrics {
+    RouteMetrics(const std::string& route, const std::vector<std::string>& stageNames)
+        : duration(MetricsRegistry::global().histogram(
+              "image_request_duration_seconds", "Time from request received to response ready",
+              {{"route", route}})),
+          inFlight(MetricsRegistry::global().gauge(
+              "image_requests_in_flight", "Requests being handled", {{"route", route}})) {
+        for (int status = 1; status <= 5; status++) {
+            responses[status - 1] = &MetricsRegistry::global().counter(
+                "image_responses_total", "Responses by status class",
+                {{"route", route}, {"status", std::to_string(status) + "xx"}});
+        }
+        for (const std::string& stage : stageNames) {
+            stages[stage] = &MetricsRegistry::global().histogram(
+                "image_stage_duration_seconds",
+                "Time spent per handler stage (wait = store lookup and image lock)",
+                {{"route", route}, {"stage", stage}});
+        }
+    }
+
+    Histogram& stage(const std::string& name) const { return *stages.at(name); }
+
+    Histogram& duration;
+    Gauge& inFlight;
+    std::array<Counter*, 5> responses;
+    std::map<std::string, Histogram*> stages;
+};
+
+// Metrics for the route a request hit, by the first path segment
+const RouteMetrics& metricsFor(const crow::request& req) {
+    static const std::map<std::string, RouteMetrics> routes = [] {
+        const std::vector<std::string> edit = {"queue", "wait", "op"};
+        std::map<std::string, RouteMetrics> m;
+        for (const char* route : {"/brightness", "/contrast", "/saturation", "/invert", "/gaussianblur",
+                                  "/vignetteffect", "/reflectHorizontally", "/reflectVertically",
+                                  "/detectEdge", "/canny", "/grayscale", "/sepia", "/compress",
+                                  "/autoLevels", "/equalize", "/clahe"}) {
+            m.emplace(route, RouteMetrics(route, edit));
+        }
+        m.emplace("/pipeline", RouteMetrics("/pipeline", {"queue", "parse", "wait", "op"}));
+        m.emplace("/preview", RouteMetrics("/preview", {"queue", "parse", "wait", "proxy", "op", "encode"}));
+        m.emplace("/commit", RouteMetrics("/commit", edit));
+        m.emplace("/uploadImage", RouteMetrics("/uploadImage", {"queue", "decode", "store"}));
+        m.emplace("/getImage", RouteMetrics("/getImage", {"wait", "encode"}));
+        m.emplace("/stats", RouteMetrics("/stats", {"queue", "wait", "analyse"}));
+        m.emplace("/metrics", RouteMetrics("/metrics", {}));
+        m.emplace("/", RouteMetrics("/", {}));
+        m.emplace("other", RouteMetrics("other", {}));
+        return m;
+    }();
+
+    const std::string& url = req.url;
+    std::string route = url.substr(0, url.find_first_of("/?", 1));
+    auto it = routes.find(route);
+    return it != routes.end() ? it->second : routes.at("other");
+}
+
+// True when an If-None-Match header lists `etag` (or is "*")
+bool etagMatches(const std::string& ifNoneMatch, const std::string& etag) {
+    size_t start = 0;
+    while (start < ifNoneMatch.size()) {
+        size_t end = ifNoneMatch.find(',', start);
+        if (end == std::string::npos) end = ifNoneMatch.size();
+        std::string tag = ifNoneMatch.substr(start, end - start);
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+        if (tag.rfind("W/", 0) == 0) tag.erase(0, 2); // Weak comparison
+        if (tag == etag || tag == "*") return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+// What a Range header asks of a body of `size` bytes. Only a single
+// "bytes=" range is served partially; anything else gets the whole body.
+struct ByteRange {
+    enum Kind { Whole, Partial, Unsatisfiable } kind = Whole;
+    size_t first = 0; // Inclusive bounds, for Partial
+    size_t last = 0;
+};
+
+ByteRange byteRange(const std::string& header, size_t size) {
+    ByteRange range;
+    if (header.rfind("bytes=", 0) != 0 || header.find(',') != std::string::npos) return range;
+    const std::string spec = header.substr(6);
+    const size_t dash = spec.find('-');
+    if (dash == std::string::npos) return range;
+    const std::string from = spec.substr(0, dash), to = spec.substr(dash + 1);
+    auto digits = [](const std::string& text) {
+        return !text.empty() && text.size() < 19 && text.find_first_not_of("0123456789") == std::string::npos;
+    };
+    if (from.empty()) {
+        // Suffix range: the last `to` bytes
+        if (!digits(to)) return range;
+        const size_t length = std::stoull(to);
+        if (length == 0 || size == 0) {
+            range.kind = ByteRange::Unsatisfiable;
+            return range;
+        }
+        range.first = size - std::min(length, size);
+    } else {
+        if (!digits(from) || (!to.empty() && !digits(to))) return range;
+        range.first = std::stoull(from);
+        if (range.first >= size) {
+            range.kind = ByteRange::Unsatisfiable;
+            return range;
+        }
+    }
+    range.last = !from.empty() && !to.empty() ? std::min<size_t>(std::stoull(to), size - 1) : size - 1;
+    if (range.last < range.first) return ByteRange();
+    range.kind = ByteRange::Partial;
+    return range;
+}
+
+// /getImage response for the encoded `imageData` tagged `etag`, or 304 when
+// it is null: the client's copy is current. A single Range (with If-Range)
+// gets 206.
+crow::response encodedResponse(const crow::request& req, const std::string& etag, const OutputFormat& format,
+                               const EncodedCache::Pointer& imageData) {
+    crow::response res(imageData ? 200 : 304);
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "no-cache"); // Revalidate: edits change the image behind the URL
+    res.set_header("Vary", "Accept");
+    if (!imageData) return res;
+
+    const std::string& bytes = *imageData;
+    res.set_header("Content-Type", format.contentType());
+    res.set_header("Accept-Ranges", "bytes");
+    // A Range is honoured only while the client's copy is still current
+    const std::string ifRange = req.get_header_value("If-Range");
+    ByteRange range = ifRange.empty() || ifRange == etag
+                          ? byteRange(req.get_header_value("Range"), bytes.size())
+                          : ByteRange();
+    if (range.kind == ByteRange::Unsatisfiable) {
+        res.code = 416;
+        res.set_header("Content-Range", "bytes */" + std::to_string(bytes.size()));
+        return res;
+    }
+    if (range.kind == ByteRange::Whole) {
+        range.last = bytes.size() - 1;
+    } else {
+        res.code = 206;
+        res.set_header("Content-Range", "bytes " + std::to_string(range.first) + "-" +
+                                            std::to_string(range.last) + "/" + std::to_string(bytes.size()));
+    }
+    // Crow sends from its own string, so the cached bytes are copied once, at their exact size
+    const size_t length = bytes.empty() ? 0 : range.last - range.first + 1;
+    res.body.assign(bytes, range.first, length);
+    res.set_header("Content-Length", std::to_string(length));
+    return res;
+}
+
+// Applies `edit` to the session's full image. The result is named by the
+// content key chained with the normalised op list, so an edit another
+// session already made is taken from the pixel cache. The edit runs on a
+// copy, so one that fails or hits its deadline leaves the image as it was.
+void applyEdit(Session& session, const Pipeline& edit) {
+    const std::string key = contentHash(session.contentKey + "|" + edit.toString());
+    PixelCache::Pointer cached = pixelCache.enabled() ? pixelCache.find(key) : nullptr;
+    if (cached) {
+        session.image = *cached;
+    } else {
+        Image result = session.image;
+        edit.execute(result);
+        session.image.swap(result);
+        if (pixelCache.enabled()) pixelCache.insert(key, std::make_shared<const Image>(session.image));
+    }
+    session.contentKey = key;
+}
+
+// Applies `edit` to the image named by the request and reports `message`
+crow::response editImage(const crow::request& req, const Pipeline& edit, const std::string& message) {
+    const RouteMetrics& metrics = metricsFor(req);
+    try {
+        const Pipeline checkedEdit = edit.checked();
+        Stopwatch watch;
+        bool found = sessions.with(sessionId(req), [&](Session& session) {
+            metrics.stage("wait").observe(watch.lap());
+            applyEdit(session, checkedEdit);
+            metrics.stage("op").observe(watch.lap());
+        });
+        if (!found) {
+            return crow::response(404, "Image not found. Upload it again.");
+        }
+        return crow::response(200, message);
+    } catch (const std::invalid_argument& e) {
+        return crow::response(400, std::string("Error: ") + e.what());
+    } catch (const std::exception& e) {
+        return crow::response(500, std::string("Error: ") + e.what());
+    }
+}
+
+// Operation chain from a request body: a JSON array such as
+// [{"op": "brightness", "value": 20}, {"op": "gaussianblur", "value": 5, "sigma": 1.5}]
+// or the text form "brightness:20,gaussianblur:5:1.5". Throws invalid_argument.
+Pipeline parsePipelineBody(const std::string& body) {
+    if (body.empty() || body.front() != '[') return Pipeline::parse(body);
+
+    auto ops = crow::json::load(body);
+    if (!ops || ops.t() != crow::json::type::List) {
+        throw std::invalid_argument("Expected a JSON array of operations.");
+    }
+    // Doubles beyond the float range cannot be cast; fromName() rejects the infinity
+    auto number = [](const crow::json::rvalue& item, const char* key) {
+        if (!item.has(key)) return 0.0f;
+        const double value = item[key].d();
+        return std::abs(value) <= std::numeric_limits<float>::max() ? static_cast<float>(value)
+                                                                    : std::numeric_limits<float>::infinity();
+    };
+    Pipeline pipeline;
+    for (const auto& item : ops) {
+        float value = number(item, "value");
+        float sigma = number(item, "sigma");
+        pipeline.add(Operation::fromName(std::string(item["op"].s()), value, sigma));
+    }
+    return pipeline;
+}
+
+// Integer query parameter clamped to [low, high], or `fallback` when absent
+int queryInt(const crow::request& req, const char* name, int fallback, int low, int high) {
+    const char* value = req.url_params.get(name);
+    return value ? std::clamp(std::atoi(value), low, high) : fallback;
+}
+
+// Response encoding from ?format= and ?quality=, or the Accept header; throws invalid_argument
+OutputFormat outputFormatFor(const crow::request& req) {
+    const char* format = req.url_params.get("format");
+    return OutputFormat::negotiate(format ? format : "", req.get_header_value("Accept"),
+                                   queryInt(req, "quality", 0, 1, 100));
+}
+
+// ?kernel=sobel|scharr&norm=l2|l1&luminance=1 of /detectEdge; throws on unknown names
+EdgeOptions edgeOptionsFromQuery(const crow::request& req) {
+    EdgeOptions options;
+    const std::string kernel = req.url_params.get("kernel") ? req.url_params.get("kernel") : "sobel";
+    const std::string norm = req.url_params.get("norm") ? req.url_params.get("norm") : "l2";
+    if (kernel != "sobel" && kernel != "scharr") throw std::invalid_argument("Unknown kernel: " + kernel);
+    if (norm != "l2" && norm != "l1") throw std::invalid_argument("Unknown norm: " + norm);
+    options.kernel = kernel == "scharr" ? EdgeKernel::Scharr : EdgeKernel::Sobel;
+    options.norm = norm == "l1" ? EdgeNorm::L1 : EdgeNorm::L2;
+    options.luminance = queryInt(req, "luminance", 0, 0, 1) == 1;
+    return options;
+}
 
+// Runs `handle` on the compute pool and ends `res` with its response. A full
+// queue is answered at once with 503 and a Retry-After estimate. The request
+// gets a deadline, ?timeout_ms= when shorter than IMAGE_DEADLINE_MS, counted
+// from admission: work still queued at the deadline is skipped, and running
+// work stops at its next band boundary (see Deadline). Both answer 503.
+void offload(const crow::request& req, crow::response& res,
+             std::function<crow::response(const crow::request&)> handle) {
+    // The task outlives this call, so it works on its own copy of the request
+    auto request = std::make_shared<const crow::request>(req);
+    auto deadline = std::make_shared<const Deadline>(
+        Deadline::Clock::now() + std::chrono::milliseconds(queryInt(req, "timeout_ms", deadlineMs, 1, deadlineMs)));
+
+    auto busy = [](const std::string& message) {
+        crow::response busy(503, message);
+        busy.set_header("Retry-After", std::to_string(computePool.retryAfterSeconds()));
+        return busy;
+    };
+
+    Stopwatch queued;
+    bool admitted = computePool.trySubmit([request, deadline, handle, busy, queued, &res]() mutable {
+        metricsFor(*request).stage("queue").observe(queued.lap());
+        crow::response out;
+        if (deadline->expired()) {
+            out = busy("Deadline passed while queued.");
+            deadlinesExceeded.inc();
+        } else {
+            ScopedDeadline scope(*deadline);
+            out = handle(*request);
+            if (deadline->wasHit()) {
+                out = busy("Deadline exceeded; the image was left unchanged.");
+                deadlinesExceeded.inc();
+            }
+        }
+        res = std::move(out);
+        res.end();
+    });
+    if (!admitted) {
+        res = busy("Server busy, try again later.");
+        res.end();
+    }
+}
 
-std::string uploadedImagePath = "uploaded_image.jpg"; // Path for the uploaded image
-std::string processedImagePath = "processed_image.jpg"; // Path for the processed image
+// Route handler that runs `handler(req, args...)` through offload()
+template <typename... Args, typename Handler>
+std::function<void(const crow::request&, crow::response&, Args...)> onComputePool(Handler handler) {
+    return [handler](const crow::request& req, crow::response& res, Args... args) {
+        offload(req, res, [handler, args...](const crow::request& request) { return handler(request, args...); });
+    };
+}
 
 
 // Middleware for CORS
@@ -29,267 +384,438 @@ struct CORS {
     }
 };
 
-
-Image convertToImageClass(const std::string& imagePath) {
-    cv::Mat img = cv::imread(imagePath, cv::IMREAD_UNCHANGED);
-    if (img.empty()) {
-        throw std::runtime_error("Failed to load image: " + imagePath);
+// Middleware timing every request end to end, per route
+struct RequestMetrics {
+    struct context {
+        const RouteMetrics* route = nullptr;
+        Stopwatch watch;
+    };
+
+    void before_handle(crow::request& req, crow::response& /*res*/, context& ctx) {
+        ctx.route = &metricsFor(req);
+        ctx.watch = Stopwatch();
+        ctx.route->inFlight.add(1);
     }
 
-    int height = img.rows;
-    int width = img.cols;
-    int channels = img.channels();
-
-    Image image(width, height, channels);
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            for (int c = 0; c < channels; c++) {
-                image.at(y, x, c) = img.at<cv::Vec3b>(y, x)[c];
-            }
-        }
+    void after_handle(crow::request& /*req*/, crow::response& res, context& ctx) {
+        if (!ctx.route) return;
+        ctx.route->duration.observe(ctx.watch.lap());
+        ctx.route->inFlight.add(-1);
+        int status = std::clamp(res.code / 100, 1, 5);
+        ctx.route->responses[status - 1]->inc();
     }
-
-    return image;
-}
-
-
-
-void saveImage(Image& myImage, const std::string& outputPath) {
-    cv::Mat processedImg;
-    if (myImage.getChannels() == 1) {
-        processedImg = cv::Mat(myImage.getHeight(), myImage.getWidth(), CV_8UC1);
-        for (int y = 0; y < myImage.getHeight(); y++) {
-            for (int x = 0; x < myImage.getWidth(); x++) {
-                processedImg.at<uint8_t>(y, x) = myImage.at(y, x, 0);
-            }
-        }
-    } else {
-        processedImg = cv::Mat(myImage.getHeight(), myImage.getWidth(), CV_8UC3);
-        for (int y = 0; y < myImage.getHeight(); y++) {
-            for (int x = 0; x < myImage.getWidth(); x++) {
-                for (int c = 0; c < myImage.getChannels(); c++) {
-                    processedImg.at<cv::Vec3b>(y, x)[c] = myImage.at(y, x, c);
-                }
-            }
-        }
-    }
-    cv::imwrite(outputPath, processedImg);
-}
-
+};
 
 
 int main(){
     //define your crow application
-    crow::App<CORS> app; 
+    crow::App<CORS, RequestMetrics> app;
+
+    // Memory gauges, read when /metrics is scraped
+    MetricsRegistry& registry = MetricsRegistry::global();
+    registry.gaugeFunction("image_store_bytes", "Pixel bytes held by stored images",
+                           [] { return static_cast<double>(sessions.bytesInUse()); });
+    registry.gaugeFunction("image_store_images", "Images in the session store",
+                           [] { return static_cast<double>(sessions.size()); });
+    registry.gaugeFunction("image_store_budget_bytes", "Session store memory budget",
+                           [] { return static_cast<double>(sessions.budgetBytes()); });
+    registry.gaugeFunction("image_cache_bytes", "Bytes held by the result caches",
+                           [] { return static_cast<double>(encodedCache.bytesInUse()); }, {{"cache", "encoded"}});
+    registry.gaugeFunction("image_cache_bytes", "Bytes held by the result caches",
+                           [] { return static_cast<double>(pixelCache.bytesInUse()); }, {{"cache", "pixels"}});
+    registry.counterFunction("image_cache_hits_total", "Result cache hits",
+                             [] { return static_cast<double>(encodedCache.hitCount()); }, {{"cache", "encoded"}});
+    registry.counterFunction("image_cache_hits_total", "Result cache hits",
+                             [] { return static_cast<double>(pixelCache.hitCount()); }, {{"cache", "pixels"}});
+    registry.counterFunction("image_cache_misses_total", "Result cache misses",
+                             [] { return static_cast<double>(encodedCache.missCount()); }, {{"cache", "encoded"}});
+    registry.counterFunction("image_cache_misses_total", "Result cache misses",
+                             [] { return static_cast<double>(pixelCache.missCount()); }, {{"cache", "pixels"}});
+    registry.gaugeFunction("image_compute_queue_depth", "Requests waiting for a compute thread",
+                           [] { return static_cast<double>(computePool.queued()); });
+    registry.counterFunction("image_compute_rejected_total", "Requests turned away with 503 because the queue was full",
+                             [] { return static_cast<double>(computePool.rejectedCount()); });
+    registry.gaugeFunction("image_pixel_bytes_allocated", "All pixel buffers allocated by Image, including temporaries",
+                           [] { return static_cast<double>(alignedBytesInUse().load()); });
+    registry.gaugeFunction("image_buffer_pool_bytes", "Free pixel buffers kept for reuse by later operations",
+                           [] { return static_cast<double>(BufferPool::shared().bytesHeld()); });
+    registry.counterFunction("image_buffer_pool_hits_total", "Pixel buffers taken from the pool",
+                             [] { return static_cast<double>(BufferPool::shared().hitCount()); });
+    registry.counterFunction("image_buffer_pool_misses_total", "Pixel buffers the pool had to allocate",
+                             [] { return static_cast<double>(BufferPool::shared().missCount()); });
 
     //define your endpoint at the root directory
     CROW_ROUTE(app, "/")([](){
         return "Image Processing API";
     });
 
-    // Define POST endpoint for image upload
-    CROW_ROUTE(app, "/uploadImage").methods(crow::HTTPMethod::Post)([] (const crow::request& req) {
+    // Define POST endpoint for image upload. The image is decoded once and kept in memory;
+    // the response carries the ID later requests pass as ?id=. Bodies over IMAGE_MAX_UPLOAD_MB
+    // and images whose header gives more pixels than DecodeLimits allow get 413.
+    auto upload = [](const crow::request& req) {
+        const RouteMetrics& metrics = metricsFor(req);
         try {
-            // Parse the request body
-            auto body = req.body;
-
-            // Write the image to the file
-            std::ofstream out(uploadedImagePath, std::ios::binary);
-            if (!out) {
-                return crow::response(500, "Failed to save the image.");
+            Stopwatch watch;
+            // Identical uploads share a content key, and the decoded image when pixels are cached
+            const std::string key = contentHash(req.body);
+            PixelCache::Pointer cached = pixelCache.enabled() ? pixelCache.find(key) : nullptr;
+            Image image = cached ? *cached : decodeImage(req.body, decodeLimits);
+            if (!cached && pixelCache.enabled()) pixelCache.insert(key, std::make_shared<const Image>(image));
+            metrics.stage("decode").observe(watch.lap());
+            crow::json::wvalue result;
+            result["width"] = image.getWidth();
+            result["height"] = image.getHeight();
+            result["channels"] = image.getChannels();
+
+            std::string id = sessions.put(std::move(image), key);
+            metrics.stage("store").observe(watch.lap());
+            {
+                std::lock_guard<std::mutex> lock(latestUploadMutex);
+                latestUploadId = id;
             }
-            out.write(body.data(), body.size());
-            out.close();
-
-            return crow::response(200, "Image uploaded successfully.");
+            result["id"] = id;
+            return crow::response(200, result);
+        } catch (const ImageTooLarge& e) {
+            return crow::response(413, std::string("Error: ") + e.what());
+        } catch (const std::invalid_argument& e) {
+            return crow::response(400, std::string("Error: ") + e.what());
         } catch (const std::exception& e) {
             return crow::response(500, std::string("Error: ") + e.what());
         }
-    });
-
-     // Define GET endpoint for fetching the uploaded image
-    CROW_ROUTE(app, "/getImage").methods(crow::HTTPMethod::Get)([]() {
-        std::ifstream file(processedImagePath, std::ios::binary);
-
-        if (!file) {
-            file.open(uploadedImagePath, std::ios::binary);
-            if (!file) {
-                return crow::response(404, "Image not found.");
-            }
+    };
+    // An oversize body is refused here on the I/O thread, before it is copied for the compute pool
+    CROW_ROUTE(app, "/uploadImage").methods(crow::HTTPMethod::Post)([upload](const crow::request& req,
+                                                                              crow::response& res) {
+        if (req.body.size() > maxUploadBytes) {
+            res = crow::response(413, "Error: Upload larger than " + std::to_string(maxUploadBytes >> 20) + " MB");
+            res.end();
+            return;
         }
-
-        // Read the image file into a string
-        std::string image_data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-        file.close();
-
-        // Set the response with the image data and proper content type
-        crow::response res;
-        res.set_header("Content-Type", "image/jpeg"); // Adjust content type as per your image format
-        res.write(image_data);
-        return res;
+        offload(req, res, upload);
     });
 
-    // Adjust brightness
-    CROW_ROUTE(app, "/brightness/<int>").methods(crow::HTTPMethod::Post)([](int adjustment) {
+     // Define GET endpoint for fetching the current state of an image, encoded only now: edits
+     // change the decoded pixels alone. ?format=jpeg|png|webp and ?quality=1-100 choose the
+     // encoding, else the Accept header does (JPEG by default). The ETag is the content key plus
+     // the encoding, so a client that already has this state gets 304 without any encoding.
+     // The image is read from its published snapshot, so this never waits for an edit in progress.
+     // Hits in the shared result cache are served from the I/O thread; a miss is encoded on the
+     // compute pool. A single Range (with If-Range) gets 206, so large
+     // results can be resumed or fetched in parts.
+    CROW_ROUTE(app, "/getImage").methods(crow::HTTPMethod::Get)([](const crow::request& req, crow::response& res) {
+        const RouteMetrics& metrics = metricsFor(req);
+        auto reply = [&res](crow::response out) {
+            res = std::move(out);
+            res.end();
+        };
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.brightnessAdjust(adjustment);
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Brightness adjusted and image saved.");
+            const OutputFormat format = outputFormatFor(req);
+            // The last published state of the image: an edit in progress is
+            // not waited for, and the result is the image as it was before it
+            Stopwatch watch;
+            const SessionStore::Snapshot snapshot = sessions.snapshot(sessionId(req));
+            metrics.stage("wait").observe(watch.lap());
+            if (!snapshot.image) {
+                return reply(crow::response(404, "Image not found."));
+            }
+            const std::string key = snapshot.contentKey + "." + format.suffix();
+            const std::string etag = "\"" + key + "\"";
+            if (etagMatches(req.get_header_value("If-None-Match"), etag)) {
+                return reply(encodedResponse(req, etag, format, nullptr));
+            }
+            if (EncodedCache::Pointer imageData = encodedCache.find(key)) {
+                return reply(encodedResponse(req, etag, format, imageData));
+            }
+
+            // A miss is encoded on the compute pool, like any other image work
+            offload(req, res, [key, etag, format, image = snapshot.image](const crow::request& request) {
+                const RouteMetrics& metrics = metricsFor(request);
+                try {
+                    Stopwatch watch;
+                    EncodedCache::Pointer imageData =
+                        encodedCache.insert(key, std::make_shared<const std::string>(encodeImage(*image, format)));
+                    metrics.stage("encode").observe(watch.lap());
+                    return encodedResponse(request, etag, format, imageData);
+                } catch (const std::exception& e) {
+                    return crow::response(500, std::string("Error: ") + e.what());
+                }
+            });
+        } catch (const std::invalid_argument& e) {
+            reply(crow::response(400, std::string("Error: ") + e.what()));
         } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
+            reply(crow::response(500, std::string("Error: ") + e.what()));
         }
     });
 
+// Adjust brightness
+    CROW_ROUTE(app, "/brightness/<int>").methods(crow::HTTPMethod::Post)(onComputePool<int>([](const crow::request& req, int adjustment) {
+        return editImage(req, Pipeline().brightness(adjustment), "Brightness adjusted.");
+    }));
+
     // Adjust contrast
-    CROW_ROUTE(app, "/contrast/<float>").methods(crow::HTTPMethod::Post)([](float factor) {
-        try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.contrastAdjust(factor);
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Contrast adjusted and image saved.");
-        } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
-        }
-    });
+    CROW_ROUTE(app, "/contrast/<float>").methods(crow::HTTPMethod::Post)(onComputePool<float>([](const crow::request& req, float factor) {
+        return editImage(req, Pipeline().contrast(factor), "Contrast adjusted.");
+    }));
 
     // Adjust saturation
-    CROW_ROUTE(app, "/saturation/<float>").methods(crow::HTTPMethod::Post)([](float factor) {
-        try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.adjustSaturation(factor);
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Saturation adjusted and image saved.");
-        } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
-        }
-    });
+    CROW_ROUTE(app, "/saturation/<float>").methods(crow::HTTPMethod::Post)(onComputePool<float>([](const crow::request& req, float factor) {
+        return editImage(req, Pipeline().saturation(factor), "Saturation adjusted.");
+    }));
 
     // Invert
-    CROW_ROUTE(app, "/invert").methods(crow::HTTPMethod::Post)([]() {
-        try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.invert();
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Image inverted and saved.");
-        } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
-        }
-    });
+    CROW_ROUTE(app, "/invert").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        return editImage(req, Pipeline().invert(), "Image inverted.");
+    }));
 
     // Apply GaussianBlur
-    CROW_ROUTE(app, "/gaussianblur/<int>").methods(crow::HTTPMethod::Post)([](int kernelSize) {
+    CROW_ROUTE(app, "/gaussianblur/<int>").methods(crow::HTTPMethod::Post)(onComputePool<int>([](const crow::request& req, int kernelSize) {
+        // Optional ?sigma=<float>, otherwise derived from the kernel size
+        float sigma = 0.0f;
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.applyGaussianBlur(kernelSize);
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "GaussianBlur applied and image saved.");
-        } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
+            if (const char* value = req.url_params.get("sigma")) sigma = std::stof(value);
+        } catch (const std::exception&) {
+            return crow::response(400, "Invalid sigma.");
         }
-    });
+        try {
+            checkBlurArguments(static_cast<float>(kernelSize), sigma);
+        } catch (const std::invalid_argument& e) {
+            return crow::response(400, std::string("Error: ") + e.what());
+        }
+        return editImage(req, Pipeline().gaussianBlur(kernelSize, sigma), "GaussianBlur applied.");
+    }));
 
     // Apply VignetteEffect
-    CROW_ROUTE(app, "/vignetteffect/<float>").methods(crow::HTTPMethod::Post)([](float strength) {
+    CROW_ROUTE(app, "/vignetteffect/<float>").methods(crow::HTTPMethod::Post)(onComputePool<float>([](const crow::request& req, float strength) {
+        return editImage(req, Pipeline().vignette(strength), "VignetteEffect applied.");
+    }));
+
+    // Reflect Horizontally
+    CROW_ROUTE(app, "/reflectHorizontally").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        return editImage(req, Pipeline().reflectHorizontally(), "Image Reflected Horizontally.");
+    }));
+
+    // Reflect Vertically
+    CROW_ROUTE(app, "/reflectVertically").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        return editImage(req, Pipeline().reflectVertically(), "Image Reflected Vertically.");
+    }));
+
+    // Edge Detection, optionally ?kernel=scharr, ?norm=l1 and ?luminance=1
+    CROW_ROUTE(app, "/detectEdge").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        EdgeOptions options;
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.addVignetteEffect(strength);
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "VignetteEffect applied and image saved.");
+            options = edgeOptionsFromQuery(req);
         } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
+            return crow::response(400, e.what());
         }
-    });
+        return editImage(req, Pipeline().edgeDetect(options), "Edge Detection Complete");
+    }));
 
-    // Reflect Horizontally
-    CROW_ROUTE(app, "/reflectHorizontally").methods(crow::HTTPMethod::Post)([]() {
+    // Canny edges, optionally ?low=<float>&high=<float> (default 50 and 150)
+    CROW_ROUTE(app, "/canny").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        float low = 50.0f, high = 150.0f;
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.reflectHorizontally();
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Image Reflected Horizontally and saved.");
-        } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
+            if (const char* value = req.url_params.get("low")) low = std::stof(value);
+            if (const char* value = req.url_params.get("high")) high = std::stof(value);
+        } catch (const std::exception&) {
+            return crow::response(400, "Invalid threshold.");
         }
-    });
+        if (low < 0 || high < low) return crow::response(400, "Thresholds must satisfy 0 <= low <= high.");
+        return editImage(req, Pipeline().canny(low, high), "Canny Edge Detection Complete");
+    }));
 
-    // Reflect Vertically
-    CROW_ROUTE(app, "/reflectVertically").methods(crow::HTTPMethod::Post)([]() {
+    // Convert to grayscale
+    CROW_ROUTE(app, "/grayscale").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        return editImage(req, Pipeline().grayscale(), "Image converted to grayscale.");
+    }));
+
+    // Convert to sepia
+    CROW_ROUTE(app, "/sepia").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        return editImage(req, Pipeline().sepia(), "Image converted to sepia.");
+    }));
+
+    // Image Compression
+    CROW_ROUTE(app, "/compress/<float>").methods(crow::HTTPMethod::Post)(onComputePool<float>([](const crow::request& req, float quality) {
+        return editImage(req, Pipeline().compress(quality), "Image compressed.");
+    }));
+
+    // Automatic exposure fixes from the image's own histogram.
+    // ?clip=<fraction> of pixels allowed to clip at each end (default 0.005)
+    CROW_ROUTE(app, "/autoLevels").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        float clip = 0.005f;
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.reflectVertically();
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Image Reflected Vertically and saved.");
-        } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
+            if (const char* value = req.url_params.get("clip")) clip = std::stof(value);
+        } catch (const std::exception&) {
+            return crow::response(400, "Invalid clip.");
         }
-    });
+        if (clip < 0 || clip >= 0.5f) return crow::response(400, "clip must be in [0, 0.5).");
+        return editImage(req, Pipeline().autoLevels(clip), "Levels adjusted.");
+    }));
 
-    // Edge Detection
-    CROW_ROUTE(app, "/detectEdge").methods(crow::HTTPMethod::Post)([]() {
+    CROW_ROUTE(app, "/equalize").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        return editImage(req, Pipeline().equalize(), "Histogram equalized.");
+    }));
+
+    // ?clip=<limit> (default 2) and ?tiles=<grid size> (default 8)
+    CROW_ROUTE(app, "/clahe").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        float clipLimit = 2.0f;
+        try {
+            if (const char* value = req.url_params.get("clip")) clipLimit = std::stof(value);
+        } catch (const std::exception&) {
+            return crow::response(400, "Invalid clip.");
+        }
+        if (clipLimit <= 0) return crow::response(400, "clip must be positive.");
+        const int tiles = queryInt(req, "tiles", 8, 1, 64);
+        return editImage(req, Pipeline().clahe(clipLimit, tiles), "CLAHE applied.");
+    }));
+
+    // Per-channel histogram and statistics of the current image, so a client
+    // can choose corrections without trial and error
+    CROW_ROUTE(app, "/stats").methods(crow::HTTPMethod::Get)(onComputePool<>([](const crow::request& req) {
+        const RouteMetrics& metrics = metricsFor(req);
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.sobelEdgeDetection();
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Edge Detection Complete");
+            crow::json::wvalue result;
+            Stopwatch watch;
+            bool found = sessions.with(sessionId(req), [&](Session& session) {
+                metrics.stage("wait").observe(watch.lap());
+                const std::vector<ChannelHistogram> counts = session.image.histograms();
+                result["width"] = session.image.getWidth();
+                result["height"] = session.image.getHeight();
+                result["format"] = pixelFormatName(session.image.getPixelFormat());
+                for (size_t c = 0; c < counts.size(); c++) {
+                    crow::json::wvalue channel;
+                    channel["min"] = counts[c].min();
+                    channel["max"] = counts[c].max();
+                    channel["mean"] = counts[c].mean();
+                    channel["stddev"] = counts[c].standardDeviation();
+                    channel["p1"] = counts[c].percentile(0.01);
+                    channel["median"] = counts[c].percentile(0.5);
+                    channel["p99"] = counts[c].percentile(0.99);
+                    for (unsigned v = 0; v < 256; v++) {
+                        channel["histogram"][v] = static_cast<uint64_t>(counts[c].bins[v]);
+                    }
+                    result["channels"][static_cast<unsigned>(c)] = std::move(channel);
+                }
+                metrics.stage("analyse").observe(watch.lap());
+            });
+            if (!found) {
+                return crow::response(404, "Image not found.");
+            }
+            return crow::response(200, result);
+        } catch (const std::invalid_argument& e) {
+            return crow::response(400, std::string("Error: ") + e.what());
         } catch (const std::exception& e) {
             return crow::response(500, std::string("Error: ") + e.what());
         }
-    });
+    }));
 
-    // Convert to grayscale
-    CROW_ROUTE(app, "/grayscale").methods(crow::HTTPMethod::Post)([]() {
+    // Apply a whole chain of operations in one request, planned and fused as one pipeline.
+    // Body: a JSON array or text op list, see parsePipelineBody()
+    CROW_ROUTE(app, "/pipeline").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        Pipeline pipeline;
+        Stopwatch watch;
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.rgbToGrayscale();
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Image converted to grayscale and saved.");
+            pipeline = parsePipelineBody(req.body);
         } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
+            return crow::response(400, std::string("Error: ") + e.what());
         }
-    });
+        metricsFor(req).stage("parse").observe(watch.lap());
+
+        return editImage(req, pipeline, "Pipeline applied.");
+    }));
+
+    // Preview an op list on a screen-sized proxy and return it as JPEG, without touching the
+    // full image. The body replaces the pending op list, so a slider sends its whole state each
+    // time. ?width=&height= bound the proxy (default 1280x960); it is rebuilt from the full
+    // image only after a commit or a size change. The encoding is negotiated as for /getImage.
+    CROW_ROUTE(app, "/preview").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        const RouteMetrics& metrics = metricsFor(req);
+        const int maxWidth = queryInt(req, "width", 1280, 16, 4096);
+        const int maxHeight = queryInt(req, "height", 960, 16, 4096);
+        Pipeline pipeline;
+        OutputFormat format;
+        Stopwatch watch;
+        try {
+            pipeline = parsePipelineBody(req.body);
+            format = outputFormatFor(req);
+        } catch (const std::exception& e) {
+            return crow::response(400, std::string("Error: ") + e.what());
+        }
+        metrics.stage("parse").observe(watch.lap());
 
-    // Convert to sepia
-    CROW_ROUTE(app, "/sepia").methods(crow::HTTPMethod::Post)([]() {
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.convertToSepia();
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Image converted to sepia and saved.");
+            std::string imageData;
+            bool found = sessions.with(sessionId(req), [&](Session& session) {
+                metrics.stage("wait").observe(watch.lap());
+                Preview& preview = session.preview;
+                if (preview.sourceKey != session.contentKey || preview.maxWidth != maxWidth ||
+                    preview.maxHeight != maxHeight) {
+                    preview.proxy = fitWithin(session.image, maxWidth, maxHeight);
+                    preview.sourceKey = session.contentKey;
+                    preview.maxWidth = maxWidth;
+                    preview.maxHeight = maxHeight;
+                }
+                metrics.stage("proxy").observe(watch.lap());
+
+                Image result = preview.proxy;
+                float scale = static_cast<float>(result.getWidth()) / std::max(1, session.image.getWidth());
+                pipeline.scaled(scale).execute(result);
+                preview.pending = pipeline;
+                metrics.stage("op").observe(watch.lap());
+
+                imageData = encodeImage(result, format);
+                metrics.stage("encode").observe(watch.lap());
+            });
+            if (!found) {
+                return crow::response(404, "Image not found. Upload it again.");
+            }
+
+            crow::response res(200);
+            res.set_header("Content-Type", format.contentType());
+            res.set_header("Cache-Control", "no-store");
+            res.write(imageData);
+            return res;
+        } catch (const std::invalid_argument& e) {
+            return crow::response(400, std::string("Error: ") + e.what());
         } catch (const std::exception& e) {
             return crow::response(500, std::string("Error: ") + e.what());
         }
-    });
+    }));
 
-    // Image Compression
-    CROW_ROUTE(app, "/compress/<float>").methods(crow::HTTPMethod::Post)([](float quality) {
+    // Replay the pending op list from /preview on the full-resolution image
+    CROW_ROUTE(app, "/commit").methods(crow::HTTPMethod::Post)(onComputePool<>([](const crow::request& req) {
+        const RouteMetrics& metrics = metricsFor(req);
         try {
-            std::string pathToLoad = std::filesystem::exists(processedImagePath) ? processedImagePath : uploadedImagePath;
-            Image myImage = convertToImageClass(pathToLoad);
-            myImage.compressImage(quality);
-            saveImage(myImage, processedImagePath);
-            return crow::response(200, "Image compressed and saved.");
+            bool applied = false;
+            Stopwatch watch;
+            bool found = sessions.with(sessionId(req), [&](Session& session) {
+                metrics.stage("wait").observe(watch.lap());
+                if (session.preview.pending.empty()) return;
+                // Cleared only once the replay succeeded, so a failed or timed-out commit can be retried
+                applyEdit(session, session.preview.pending);
+                session.preview.pending = Pipeline();
+                applied = true;
+                metrics.stage("op").observe(watch.lap());
+            });
+            if (!found) {
+                return crow::response(404, "Image not found. Upload it again.");
+            }
+            return crow::response(200, applied ? "Preview committed." : "Nothing to commit.");
+        } catch (const std::invalid_argument& e) {
+            return crow::response(400, std::string("Error: ") + e.what());
         } catch (const std::exception& e) {
             return crow::response(500, std::string("Error: ") + e.what());
         }
-    });
+    }));
 
 
+    // Prometheus scrape endpoint: request and per-stage latency histograms, in-flight requests, image memory
+    CROW_ROUTE(app, "/metrics").methods(crow::HTTPMethod::Get)([]() {
+        crow::response res(200, MetricsRegistry::global().render());
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
+    });
+
     //set the port, set the app to run on multiple threads, and run the app
     app.port(18080).multithreaded().run();
     return 0;
 }
-
-
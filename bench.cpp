@@ -0,0 +1,291 @@
+// Micro-benchmarks for every Image operation across frame sizes, channel
+// counts and parameters. Needs only the headers in src/, no OpenCV.
+//
+//   ./bench                              # all cases, JSON to bench.json
+//   ./bench --quick --filter blur        # VGA and 1080p only, blur cases only
+//   ./bench --baseline base.json         # fail when a case got >10% slower
+#include "src/image_processing.hpp"
+#include "src/pipeline.hpp"
+#include "src/pyramid.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+struct FrameSize {
+    const char* name;
+    int width;
+    int height;
+};
+
+struct BenchCase {
+    std::string name;
+    std::function<void(Image&)> run;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string size;
+    int width;
+    int height;
+    int channels;
+    double ms;   // Median of the repetitions
+    double mpps; // Megapixels per second at the median
+};
+
+
+std::vector<BenchCase> benchCases() {
+    std::vector<BenchCase> cases = {
+        {"brightness", [](Image& im) { im.brightnessAdjust(20); }},
+        {"contrast", [](Image& im) { im.contrastAdjust(1.2f); }},
+        {"saturation", [](Image& im) { im.adjustSaturation(1.3f); }},
+        {"invert", [](Image& im) { im.invert(); }},
+        {"vignette", [](Image& im) { im.addVignetteEffect(0.5f); }},
+        {"reflectHorizontally", [](Image& im) { im.reflectHorizontally(); }},
+        {"reflectVertically", [](Image& im) { im.reflectVertically(); }},
+        {"rotate90", [](Image& im) { im.rotate90(); }},
+        {"rotate180", [](Image& im) { im.rotate180(); }},
+        {"transpose", [](Image& im) { im.transpose(); }},
+        {"sobel", [](Image& im) { im.sobelEdgeDetection(); }},
+        {"sobel/luminance+l1", [](Image& im) {
+            EdgeOptions options;
+            options.norm = EdgeNorm::L1;
+            options.luminance = true;
+            im.detectEdges(options);
+        }},
+        {"scharr", [](Image& im) {
+            EdgeOptions options;
+            options.kernel = EdgeKernel::Scharr;
+            im.detectEdges(options);
+        }},
+        {"canny", [](Image& im) { im.cannyEdges(); }},
+        {"histograms", [](Image& im) { im.histograms(); }},
+        {"autoLevels", [](Image& im) { im.autoLevels(); }},
+        {"equalize", [](Image& im) { im.equalizeHistogram(); }},
+        {"clahe", [](Image& im) { im.applyClahe(); }},
+        {"grayscale", [](Image& im) { im.rgbToGrayscale(); }},
+        {"sepia", [](Image& im) { im.convertToSepia(); }},
+        {"hueRotate", [](Image& im) { im.hueRotate(30); }},
+        {"colorMatrix/saturation+hueRotate+sepia", [](Image& im) {
+            static const ColorMatrix grade = ColorMatrix::saturation(0.8f)
+                                                 .then(ColorMatrix::hueRotate(15))
+                                                 .then(ColorMatrix::sepia());
+            im.applyColorMatrix(grade);
+        }},
+        {"compress", [](Image& im) { im.compressImage(0.8f); }},
+        {"halfSize", [](Image& im) { im = im.halfSize(); }},
+        {"fitWithin/1280x960", [](Image& im) { im = fitWithin(im, 1280, 960); }},
+        {"lut/brightness+contrast+posterize", [](Image& im) {
+            static const PointOp op = PointOp::brightness(20)
+                                          .then(PointOp::contrast(1.2f))
+                                          .then(PointOp::posterize(0.8f));
+            im.applyLUT(op);
+        }},
+        {"pipeline/brightness,contrast,gaussianblur:5,grayscale", [](Image& im) {
+            static const Pipeline pipeline = Pipeline::parse("brightness:20,contrast:1.2,gaussianblur:5,grayscale");
+            pipeline.execute(im);
+        }},
+    };
+    for (int kernel : {3, 7, 15, 31}) {
+        cases.push_back({"gaussianblur/k=" + std::to_string(kernel),
+                         [kernel](Image& im) { im.applyGaussianBlur(kernel); }});
+    }
+    return cases;
+}
+
+// Deterministic, textured content so that no kernel hits a trivial fast path
+Image testImage(int width, int height, int channels) {
+    Image image = Image::uninitialized(width, height, channels);
+    uint32_t state = 12345;
+    for (int y = 0; y < height; y++) {
+        uint8_t* p = image.row(y);
+        for (int i = 0; i < width * channels; i++) {
+            state = state * 1664525u + 1013904223u;
+            p[i] = static_cast<uint8_t>((i / channels + y) / 4 + (state >> 28));
+        }
+    }
+    return image;
+}
+
+// Runs `run` on fresh copies of `source` until both minReps and minSeconds
+// are reached; the copy is not timed
+double medianMilliseconds(const Image& source, const std::function<void(Image&)>& run,
+                          int minReps, double minSeconds) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> samples;
+    double total = 0;
+    while (static_cast<int>(samples.size()) < minReps || (total < minSeconds && samples.size() < 1000)) {
+        Image work = source;
+        auto start = Clock::now();
+        run(work);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        samples.push_back(ms);
+        total += ms / 1000;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+std::string resultKey(const std::string& name, const std::string& size, int channels) {
+    return name + "|" + size + "|c" + std::to_string(channels);
+}
+
+void writeJson(const std::vector<BenchResult>& results, const std::string& path) {
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("Failed to write " + path);
+    out << "{\n  \"simd\": \"" << pointKernels().name << "\",\n"
+        << "  \"threads\": " << Parallel::pool()->size() << ",\n"
+        << "  \"results\": [\n";
+    // One result per line, which is what readBaseline() relies on
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": \"%s\", \"size\": \"%s\", \"width\": %d, \"height\": %d, "
+                      "\"channels\": %d, \"ms\": %.3f, \"mpps\": %.2f}%s\n",
+                      r.name.c_str(), r.size.c_str(), r.width, r.height, r.channels, r.ms, r.mpps,
+                      i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+// Megapixels/s by case from a file written by writeJson()
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Failed to open baseline " + path);
+
+    auto field = [](const std::string& line, const std::string& key) -> std::string {
+        size_t at = line.find("\"" + key + "\": ");
+        if (at == std::string::npos) return "";
+        at += key.size() + 4;
+        if (line[at] == '"') return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+        return line.substr(at, line.find_first_of(",}", at) - at);
+    };
+
+    std::map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string name = field(line, "name");
+        if (name.empty()) continue;
+        baseline[resultKey(name, field(line, "size"), std::stoi(field(line, "channels")))] =
+            std::stod(field(line, "mpps"));
+    }
+    return baseline;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --quick              VGA and 1080p only\n"
+              << "  --sizes <list>       Comma-separated subset of vga,720p,1080p,12mp,24mp\n"
+              << "  --channels <list>    Comma-separated subset of 1,3,4\n"
+              << "  --filter <text>      Only cases whose name contains <text>\n"
+              << "  --reps <n>           Minimum repetitions per case (default: 5)\n"
+              << "  --out <file>         JSON output (default: bench.json)\n"
+              << "  --baseline <file>    Compare with an earlier run\n"
+              << "  --tolerance <frac>   Allowed slowdown before a case counts as a regression (default: 0.10)\n";
+}
+
+int main(int argc, char** argv) {
+    const std::vector<FrameSize> allSizes = {
+        {"vga", 640, 480}, {"720p", 1280, 720}, {"1080p", 1920, 1080},
+        {"12mp", 4000, 3000}, {"24mp", 6000, 4000},
+    };
+    std::vector<std::string> sizeNames = {"vga", "720p", "1080p", "12mp", "24mp"};
+    std::vector<int> channelCounts = {1, 3, 4};
+    std::string filter, outPath = "bench.json", baselinePath;
+    int minReps = 5;
+    double tolerance = 0.10;
+
+    auto splitList = [](const std::string& list) {
+        std::vector<std::string> items;
+        std::stringstream in(list);
+        std::string item;
+        while (std::getline(in, item, ',')) if (!item.empty()) items.push_back(item);
+        return items;
+    };
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--quick") sizeNames = {"vga", "1080p"};
+            else if (arg == "--sizes") sizeNames = splitList(next());
+            else if (arg == "--channels") {
+                channelCounts.clear();
+                for (const std::string& c : splitList(next())) channelCounts.push_back(std::stoi(c));
+            }
+            else if (arg == "--filter") filter = next();
+            else if (arg == "--reps") minReps = std::max(1, std::stoi(next()));
+            else if (arg == "--out") outPath = next();
+            else if (arg == "--baseline") baselinePath = next();
+            else if (arg == "--tolerance") tolerance = std::stod(next());
+            else {
+                printUsage(argv[0]);
+                return arg == "-h" || arg == "--help" ? 0 : 2;
+            }
+        }
+
+        std::cout << "SIMD: " << pointKernels().name << ", threads: " << Parallel::pool()->size() << '\n';
+
+        std::vector<BenchResult> results;
+        const std::vector<BenchCase> cases = benchCases();
+        for (const std::string& sizeName : sizeNames) {
+            auto size = std::find_if(allSizes.begin(), allSizes.end(),
+                                     [&](const FrameSize& s) { return sizeName == s.name; });
+            if (size == allSizes.end()) throw std::invalid_argument("Unknown size " + sizeName);
+
+            for (int channels : channelCounts) {
+                const Image source = testImage(size->width, size->height, channels);
+                for (const BenchCase& c : cases) {
+                    if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+
+                    double ms = medianMilliseconds(source, c.run, minReps, 0.25);
+                    double mpps = size->width * double(size->height) / 1e6 / (ms / 1000);
+                    results.push_back({c.name, size->name, size->width, size->height, channels, ms, mpps});
+
+                    char line[256];
+                    std::snprintf(line, sizeof(line), "%-56s %-6s c%d %10.3f ms %9.1f MP/s\n",
+                                  c.name.c_str(), size->name, channels, ms, mpps);
+                    std::cout << line << std::flush;
+                }
+            }
+        }
+
+        writeJson(results, outPath);
+        std::cout << "Wrote " << results.size() << " results to " << outPath << '\n';
+
+        if (baselinePath.empty()) return 0;
+
+        const std::map<std::string, double> baseline = readBaseline(baselinePath);
+        int regressions = 0;
+        for (const BenchResult& r : results) {
+            auto it = baseline.find(resultKey(r.name, r.size, r.channels));
+            if (it == baseline.end()) continue;
+            double change = r.mpps / it->second - 1;
+            if (change < -tolerance) {
+                regressions++;
+                char line[256];
+                std::snprintf(line, sizeof(line), "REGRESSION %s %s c%d: %.1f -> %.1f MP/s (%+.0f%%)\n",
+                              r.name.c_str(), r.size.c_str(), r.channels, it->second, r.mpps, change * 100);
+                std::cout << line;
+            }
+        }
+        std::cout << regressions << " regression(s) against " << baselinePath << '\n';
+        return regressions ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 2;
+    }
+}
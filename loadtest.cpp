@@ -0,0 +1,544 @@
+// HTTP load generator for the image server (app.cpp). Replays a weighted mix
+// of uploads, edits and downloads against a running instance and reports
+// requests/s and latency percentiles per route. Needs only POSIX sockets.
+//
+//   ./loadtest                                    # 8 connections for 10 s, default mix
+//   ./loadtest --rate 200 --duration 30           # fixed arrival rate instead
+//   ./loadtest --mix upload:1,getImage:8,brightness:2 --out before.json
+//
+// Each connection uploads its own copy of an image first and then edits and
+// fetches that one, so connections do not queue behind each other's session.
+// The route of every request comes from --seed, so two runs send the same
+// sequence. With --rate, latency counts from the time a request was due, not
+// from when a connection was free to send it, so a stalled server shows up as
+// latency instead of as fewer requests.
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using Clock = std::chrono::steady_clock;
+
+// One kind of request the mix can contain. `path` gets ?id= of the
+// connection's image appended unless `global` is set.
+struct RouteSpec {
+    const char* name;
+    const char* method;
+    const char* path;
+    const char* body; // Fixed body; uploads send an image instead
+    bool global;
+};
+
+const std::vector<RouteSpec>& routeSpecs() {
+    static const std::vector<RouteSpec> specs = {
+        {"upload", "POST", "/uploadImage", "", true},
+        {"getImage", "GET", "/getImage", "", false},
+        {"getImage/webp", "GET", "/getImage?format=webp", "", false},
+        {"brightness", "POST", "/brightness/10", "", false},
+        {"contrast", "POST", "/contrast/1.1", "", false},
+        {"saturation", "POST", "/saturation/1.2", "", false},
+        {"invert", "POST", "/invert", "", false},
+        {"gaussianblur", "POST", "/gaussianblur/5", "", false},
+        {"vignette", "POST", "/vignetteffect/0.5", "", false},
+        {"reflectHorizontally", "POST", "/reflectHorizontally", "", false},
+        {"detectEdge", "POST", "/detectEdge", "", false},
+        {"canny", "POST", "/canny", "", false},
+        {"sepia", "POST", "/sepia", "", false},
+        {"equalize", "POST", "/equalize", "", false},
+        {"stats", "GET", "/stats", "", false},
+        {"pipeline", "POST", "/pipeline", "brightness:10,contrast:1.1,gaussianblur:5", false},
+        {"preview", "POST", "/preview", "brightness:10,contrast:1.1,saturation:1.2", false},
+        {"metrics", "GET", "/metrics", "", true},
+    };
+    return specs;
+}
+
+struct MixEntry {
+    const RouteSpec* route;
+    int weight;
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "18080";
+    std::vector<std::string> imagePaths = {"example.jpg", "fetch.jpg"};
+    std::string mix = "upload:1,getImage:6,brightness:2,gaussianblur:1";
+    int concurrency = 8;
+    double rate = 0; // Requests per second over all connections; 0 = closed loop
+    double duration = 10;
+    double warmup = 1; // Seconds at the start that are run but not reported
+    int timeoutMs = 30000;
+    uint64_t seed = 1;
+    std::string outPath = "loadtest.json";
+};
+
+// Latency of one finished request, by route index
+struct Sample {
+    int route;
+    int status; // 0 when the connection failed
+    double ms;
+};
+
+struct RouteReport {
+    std::string name;
+    size_t requests = 0;
+    size_t errors = 0; // Failed connections and 4xx/5xx answers
+    double rps = 0;
+    double mean = 0, p50 = 0, p95 = 0, p99 = 0, p999 = 0, max = 0;
+    std::map<int, size_t> statuses;
+};
+
+
+// Mix weights from "name:weight,..."; a missing weight counts as 1
+std::vector<MixEntry> parseMix(const std::string& text) {
+    std::vector<MixEntry> mix;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (item.empty()) continue;
+        const size_t colon = item.rfind(':');
+        const std::string name = item.substr(0, colon);
+        const int weight = colon == std::string::npos ? 1 : std::stoi(item.substr(colon + 1));
+        auto spec = std::find_if(routeSpecs().begin(), routeSpecs().end(),
+                                 [&](const RouteSpec& s) { return name == s.name; });
+        if (spec == routeSpecs().end()) throw std::invalid_argument("Unknown route " + name);
+        if (weight < 0) throw std::invalid_argument("Negative weight for " + name);
+        if (weight > 0) mix.push_back({&*spec, weight});
+    }
+    if (mix.empty()) throw std::invalid_argument("Empty route mix");
+    return mix;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Failed to open " + path);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// splitmix64: the n-th request of a stream picks its route from this, so the
+// sequence depends on the seed alone and not on thread timing
+uint64_t mixHash(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+const RouteSpec* pickRoute(const std::vector<MixEntry>& mix, uint64_t draw) {
+    int total = 0;
+    for (const MixEntry& e : mix) total += e.weight;
+    int at = static_cast<int>(draw % static_cast<uint64_t>(total));
+    for (const MixEntry& e : mix) {
+        if (at < e.weight) return e.route;
+        at -= e.weight;
+    }
+    return mix.back().route;
+}
+
+
+// One keep-alive HTTP/1.1 connection. Reconnects on demand; a request that
+// finds an idle connection closed by the server is retried once on a new one.
+class Connection {
+public:
+    Connection(const Options& options) : options(options) {}
+    ~Connection() { close(); }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    // Sends one request and returns the status code, the body in `body`;
+    // throws std::runtime_error when the server cannot be reached or answers
+    // with something that is not HTTP
+    int request(const char* method, const std::string& target, const std::string& payload, std::string& body) {
+        std::string head = std::string(method) + " " + target + " HTTP/1.1\r\n" +
+                           "Host: " + options.host + ":" + options.port + "\r\n" +
+                           "Connection: keep-alive\r\n";
+        if (!payload.empty() || std::strcmp(method, "POST") == 0) {
+            head += "Content-Type: application/octet-stream\r\n";
+            head += "Content-Length: " + std::to_string(payload.size()) + "\r\n";
+        }
+        head += "\r\n";
+        head += payload; // One write, so the request is not split across segments
+
+        for (int attempt = 0;; attempt++) {
+            const bool reused = fd >= 0;
+            timedOut = false;
+            if (!reused) open();
+            if (sendAll(head)) {
+                int status = readResponse(body);
+                if (status > 0) return status;
+            }
+            close();
+            // Only a stale keep-alive connection is worth a second try, not a timeout
+            if (!reused || attempt > 0 || timedOut) throw std::runtime_error("Connection to " + options.host + " failed");
+        }
+    }
+
+private:
+    const Options& options;
+    int fd = -1;
+    std::string buffer; // Bytes received past the end of the last response
+    bool timedOut = false;
+
+    void open() {
+        addrinfo hints{}, *found = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &found) != 0 || !found) {
+            throw std::runtime_error("Cannot resolve " + options.host);
+        }
+        for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+            fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd < 0) continue;
+            if (::connect(fd, a->ai_addr, a->ai_addrlen) != 0) close();
+        }
+        freeaddrinfo(found);
+        if (fd < 0) throw std::runtime_error("Cannot connect to " + options.host + ":" + options.port);
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        timeval timeout{options.timeoutMs / 1000, (options.timeoutMs % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        buffer.clear();
+    }
+
+    void close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    bool sendAll(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Appends what the socket has to `buffer`; false on close, error or timeout
+    bool receive() {
+        char chunk[65536];
+        for (;;) {
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) timedOut = true;
+            if (n <= 0) return false;
+            buffer.append(chunk, static_cast<size_t>(n));
+            return true;
+        }
+    }
+
+    // Status of the next response, 0 when the connection ended before one
+    // arrived. Bodies are delimited by Content-Length, or by the close.
+    int readResponse(std::string& body) {
+        size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!receive()) return 0;
+        }
+        const std::string headers = buffer.substr(0, end + 2);
+        buffer.erase(0, end + 4);
+        if (headers.compare(0, 5, "HTTP/") != 0) throw std::runtime_error("Malformed response from server");
+        const int status = std::atoi(headers.c_str() + headers.find(' ') + 1);
+
+        std::string lower = headers;
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+        const size_t length = lower.find("\r\ncontent-length:");
+        const bool keepAlive = lower.find("\r\nconnection: close") == std::string::npos;
+        if (status == 204 || status == 304 || (status >= 100 && status < 200)) {
+            body.clear();
+        } else if (length != std::string::npos) {
+            const size_t size = std::strtoull(headers.c_str() + length + 17, nullptr, 10);
+            while (buffer.size() < size) {
+                if (!receive()) return 0;
+            }
+            body.assign(buffer, 0, size);
+            buffer.erase(0, size);
+        } else {
+            while (receive()) {}
+            body.swap(buffer);
+            buffer.clear();
+            close();
+            return status;
+        }
+        if (!keepAlive) close();
+        return status;
+    }
+};
+
+
+// Session ID from the JSON /uploadImage answers with
+std::string uploadedId(const std::string& json) {
+    size_t at = json.find("\"id\"");
+    if (at != std::string::npos) at = json.find('"', json.find(':', at) + 1);
+    if (at == std::string::npos) throw std::runtime_error("Upload response without an id: " + json.substr(0, 200));
+    return json.substr(at + 1, json.find('"', at + 1) - at - 1);
+}
+
+// One connection's share of the run. In closed-loop mode it sends its next
+// request as soon as the last one is answered; with a rate, it takes the next
+// free slot of the shared schedule and waits for that slot's due time.
+void runWorker(const Options& options, const std::vector<MixEntry>& mix, const std::vector<std::string>& images,
+               int worker, Clock::time_point start, std::atomic<uint64_t>& nextSlot, std::vector<Sample>& samples) {
+    using std::chrono::duration;
+    using std::chrono::duration_cast;
+    const Clock::time_point end = start + duration_cast<Clock::duration>(duration<double>(options.duration));
+    const Clock::time_point measured = start + duration_cast<Clock::duration>(duration<double>(options.warmup));
+    const std::vector<RouteSpec>& specs = routeSpecs();
+
+    Connection connection(options);
+    std::string body;
+    std::string id;
+    size_t uploads = static_cast<size_t>(worker);
+    auto upload = [&]() -> int {
+        int status = connection.request("POST", "/uploadImage", images[uploads++ % images.size()], body);
+        if (status == 200) id = uploadedId(body);
+        return status;
+    };
+    if (upload() != 200) throw std::runtime_error("Initial upload failed: " + body.substr(0, 200));
+
+    for (uint64_t n = 0;; n++) {
+        Clock::time_point due;
+        uint64_t draw;
+        if (options.rate > 0) {
+            const uint64_t slot = nextSlot.fetch_add(1);
+            due = start + duration_cast<Clock::duration>(duration<double>(slot / options.rate));
+            if (due >= end) return;
+            std::this_thread::sleep_until(due);
+            draw = mixHash(options.seed ^ mixHash(slot));
+        } else {
+            due = Clock::now();
+            if (due >= end) return;
+            draw = mixHash(options.seed ^ mixHash((static_cast<uint64_t>(worker) << 40) + n));
+        }
+
+        const RouteSpec& route = *pickRoute(mix, draw);
+        int status = 0;
+        try {
+            if (std::strcmp(route.name, "upload") == 0) {
+                status = upload();
+            } else {
+                std::string target = route.path;
+                if (!route.global) target += (target.find('?') == std::string::npos ? "?id=" : "&id=") + id;
+                status = connection.request(route.method, target, route.body, body);
+            }
+        } catch (const std::runtime_error&) {
+            status = 0;
+        }
+        const double ms = duration<double, std::milli>(Clock::now() - due).count();
+        if (due >= measured) samples.push_back({static_cast<int>(&route - specs.data()), status, ms});
+    }
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    const size_t rank = static_cast<size_t>(p * sorted.size());
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+RouteReport summarise(const std::string& name, std::vector<double> ms, size_t errors,
+                      const std::map<int, size_t>& statuses, double seconds) {
+    RouteReport r;
+    r.name = name;
+    r.requests = ms.size();
+    r.errors = errors;
+    r.statuses = statuses;
+    r.rps = seconds > 0 ? r.requests / seconds : 0;
+    if (ms.empty()) return r;
+    std::sort(ms.begin(), ms.end());
+    double sum = 0;
+    for (double v : ms) sum += v;
+    r.mean = sum / ms.size();
+    r.p50 = percentile(ms, 0.50);
+    r.p95 = percentile(ms, 0.95);
+    r.p99 = percentile(ms, 0.99);
+    r.p999 = percentile(ms, 0.999);
+    r.max = ms.back();
+    return r;
+}
+
+std::string reportJson(const RouteReport& r) {
+    std::string statuses;
+    for (const auto& [status, count] : r.statuses) {
+        if (!statuses.empty()) statuses += ", ";
+        statuses += "\"" + std::to_string(status) + "\": " + std::to_string(count);
+    }
+    char line[768];
+    std::snprintf(line, sizeof(line),
+                  "{\"route\": \"%s\", \"requests\": %zu, \"errors\": %zu, \"rps\": %.2f, \"mean_ms\": %.3f, "
+                  "\"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"p999_ms\": %.3f, \"max_ms\": %.3f, "
+                  "\"status\": {%s}}",
+                  r.name.c_str(), r.requests, r.errors, r.rps, r.mean, r.p50, r.p95, r.p99, r.p999, r.max,
+                  statuses.c_str());
+    return line;
+}
+
+void writeJson(const Options& options, const std::vector<RouteReport>& routes, const RouteReport& total,
+               double seconds, const std::string& path) {
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("Failed to write " + path);
+    char header[512];
+    std::snprintf(header, sizeof(header),
+                  "{\n  \"target\": \"%s:%s\",\n  \"mode\": \"%s\",\n  \"concurrency\": %d,\n  \"rate\": %.2f,\n"
+                  "  \"duration_s\": %.2f,\n  \"measured_s\": %.2f,\n  \"seed\": %llu,\n  \"mix\": \"%s\",\n",
+                  options.host.c_str(), options.port.c_str(), options.rate > 0 ? "open" : "closed",
+                  options.concurrency, options.rate, options.duration, seconds,
+                  static_cast<unsigned long long>(options.seed), options.mix.c_str());
+    out << header << "  \"total\": " << reportJson(total) << ",\n  \"routes\": [\n";
+    // One route per line, as in bench.json, so runs diff line by line
+    for (size_t i = 0; i < routes.size(); i++) {
+        out << "    " << reportJson(routes[i]) << (i + 1 < routes.size() ? "," : "") << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --host <name>        Server host (default: 127.0.0.1)\n"
+              << "  --port <n>           Server port (default: 18080)\n"
+              << "  --images <list>      Comma-separated images to upload (default: example.jpg,fetch.jpg)\n"
+              << "  --mix <list>         Weighted routes, name:weight,... (default: upload:1,getImage:6,brightness:2,gaussianblur:1)\n"
+              << "  --concurrency <n>    Connections (default: 8)\n"
+              << "  --rate <n>           Requests/s over all connections; without it each connection sends back to back\n"
+              << "  --duration <s>       Length of the run, warm-up included (default: 10)\n"
+              << "  --warmup <s>         Seconds not reported (default: 1)\n"
+              << "  --timeout <ms>       Per-request socket timeout (default: 30000)\n"
+              << "  --seed <n>           Seed of the route sequence (default: 1)\n"
+              << "  --out <file>         JSON output (default: loadtest.json)\n"
+              << "Routes:";
+    for (const RouteSpec& spec : routeSpecs()) std::cerr << ' ' << spec.name;
+    std::cerr << '\n';
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    auto splitList = [](const std::string& list) {
+        std::vector<std::string> items;
+        std::stringstream in(list);
+        std::string item;
+        while (std::getline(in, item, ',')) if (!item.empty()) items.push_back(item);
+        return items;
+    };
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--host") options.host = next();
+            else if (arg == "--port") options.port = next();
+            else if (arg == "--images") options.imagePaths = splitList(next());
+            else if (arg == "--mix") options.mix = next();
+            else if (arg == "--concurrency") options.concurrency = std::max(1, std::stoi(next()));
+            else if (arg == "--rate") options.rate = std::max(0.0, std::stod(next()));
+            else if (arg == "--duration") options.duration = std::stod(next());
+            else if (arg == "--warmup") options.warmup = std::max(0.0, std::stod(next()));
+            else if (arg == "--timeout") options.timeoutMs = std::max(1, std::stoi(next()));
+            else if (arg == "--seed") options.seed = std::stoull(next());
+            else if (arg == "--out") options.outPath = next();
+            else {
+                printUsage(argv[0]);
+                return arg == "-h" || arg == "--help" ? 0 : 2;
+            }
+        }
+        if (options.duration <= options.warmup) throw std::invalid_argument("--duration must exceed --warmup");
+        if (options.imagePaths.empty()) throw std::invalid_argument("No images to upload");
+
+        const std::vector<MixEntry> mix = parseMix(options.mix);
+        std::vector<std::string> images;
+        for (const std::string& path : options.imagePaths) images.push_back(readFile(path));
+
+        std::cout << "Target " << options.host << ':' << options.port << ", " << options.concurrency
+                  << " connections, " << (options.rate > 0 ? std::to_string(options.rate) + " req/s" : "closed loop")
+                  << ", " << options.duration << " s\n";
+
+        const Clock::time_point start = Clock::now();
+        std::atomic<uint64_t> nextSlot{0};
+        std::vector<std::vector<Sample>> samples(options.concurrency);
+        std::vector<std::string> failures(options.concurrency);
+        std::vector<std::thread> workers;
+        for (int w = 0; w < options.concurrency; w++) {
+            workers.emplace_back([&, w] {
+                try {
+                    runWorker(options, mix, images, w, start, nextSlot, samples[w]);
+                } catch (const std::exception& e) {
+                    failures[w] = e.what();
+                }
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+        for (const std::string& failure : failures) {
+            if (!failure.empty()) throw std::runtime_error(failure);
+        }
+
+        const double seconds = options.duration - options.warmup;
+        const std::vector<RouteSpec>& specs = routeSpecs();
+        std::vector<std::vector<double>> byRoute(specs.size());
+        std::vector<size_t> errors(specs.size());
+        std::vector<std::map<int, size_t>> statuses(specs.size());
+        std::vector<double> all;
+        size_t allErrors = 0;
+        std::map<int, size_t> allStatuses;
+        for (const std::vector<Sample>& list : samples) {
+            for (const Sample& s : list) {
+                const bool failed = s.status == 0 || s.status >= 400;
+                byRoute[s.route].push_back(s.ms);
+                all.push_back(s.ms);
+                errors[s.route] += failed;
+                allErrors += failed;
+                statuses[s.route][s.status]++;
+                allStatuses[s.status]++;
+            }
+        }
+
+        std::vector<RouteReport> routes;
+        for (size_t i = 0; i < specs.size(); i++) {
+            if (byRoute[i].empty()) continue;
+            routes.push_back(summarise(specs[i].name, std::move(byRoute[i]), errors[i], statuses[i], seconds));
+        }
+        const RouteReport total = summarise("total", std::move(all), allErrors, allStatuses, seconds);
+
+        std::printf("%-20s %9s %7s %9s %9s %9s %9s %9s\n", "route", "requests", "errors", "req/s",
+                    "p50 ms", "p95 ms", "p99 ms", "p99.9 ms");
+        auto printRow = [](const RouteReport& r) {
+            std::printf("%-20s %9zu %7zu %9.1f %9.2f %9.2f %9.2f %9.2f\n", r.name.c_str(), r.requests, r.errors,
+                        r.rps, r.p50, r.p95, r.p99, r.p999);
+        };
+        for (const RouteReport& route : routes) printRow(route);
+        printRow(total);
+
+        writeJson(options, routes, total, seconds, options.outPath);
+        std::cout << "Wrote " << options.outPath << '\n';
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 2;
+    }
+}
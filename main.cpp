@@ -1,43 +1,105 @@
 #include "src/image_processing.hpp"
+#include "src/opencv_interop.hpp"
+#include "src/batch_processor.hpp"
+#include "src/strip_processor.hpp"
 #include <iostream>
 #include <string>
+#include <vector>
 #include <opencv2/opencv.hpp>
 
 
-Image convertToImageClass(const std::string& imagePath) {
-    cv::Mat img = cv::imread(imagePath, cv::IMREAD_UNCHANGED);
-    if (img.empty()) {
-        throw std::runtime_error("Failed to load image: " + imagePath);
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--batch <dir|list.txt|file>... --ops <chain> [options]]\n"
+              << "       " << program << " --strips <in.ppm> <out.ppm> --ops <chain> [--max-memory <MB>]\n"
+              << "  --ops <chain>       Operations to apply, e.g. \"brightness:20,gaussianblur:5,grayscale\"\n"
+              << "  --out <dir>         Output directory (default: processed)\n"
+              << "  --format <ext>      Output format, e.g. .png (default: same as input)\n"
+              << "  --decoders <n>      Decode workers\n"
+              << "  --workers <n>       Processing workers\n"
+              << "  --encoders <n>      Encode workers\n"
+              << "  --queue <n>         Images buffered between stages (default: 8)\n"
+              << "  --max-memory <MB>   Memory for strips and thread scratch (default: 256)\n"
+              << "--strips streams binary PGM/PPM files of any size through a fixed amount of memory.\n"
+              << "Without --batch, processes example.jpeg into processed_image.jpeg.\n";
+}
+
+int runBatch(int argc, char** argv) {
+    BatchOptions options;
+    std::vector<std::string> inputs;
+    std::string ops;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--batch") continue;
+        else if (arg == "--ops") ops = next();
+        else if (arg == "--out") options.outputDir = next();
+        else if (arg == "--format") options.outputExtension = next();
+        else if (arg == "--decoders") options.decodeWorkers = std::stoi(next());
+        else if (arg == "--workers") options.processWorkers = std::stoi(next());
+        else if (arg == "--encoders") options.encodeWorkers = std::stoi(next());
+        else if (arg == "--queue") options.queueDepth = std::stoul(next());
+        else if (arg.rfind("--", 0) == 0) throw std::invalid_argument("Unknown option " + arg);
+        else inputs.push_back(arg);
     }
 
-    int height = img.rows;
-    int width = img.cols;
-    int channels = img.channels();
+    if (!options.outputExtension.empty() && options.outputExtension.front() != '.') {
+        options.outputExtension.insert(0, ".");
+    }
+    options.pipeline = Pipeline::parse(ops);
+    options.inputs = collectInputs(inputs);
+    if (options.inputs.empty()) throw std::invalid_argument("No input images");
 
-    Image image(width, height, channels);
+    BatchReport report = BatchProcessor(options).run();
+    report.print(std::cout);
+    return report.failed ? 1 : 0;
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            for (int c = 0; c < channels; c++) {
-                image.at(y, x, c) = img.at<cv::Vec3b>(y, x)[c];
-            }
-        }
+int runStrips(int argc, char** argv) {
+    StripOptions options;
+    std::vector<std::string> paths;
+    std::string ops;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--strips") continue;
+        else if (arg == "--ops") ops = next();
+        else if (arg == "--max-memory") options.memoryLimit = std::stoul(next()) << 20;
+        else if (arg.rfind("--", 0) == 0) throw std::invalid_argument("Unknown option " + arg);
+        else paths.push_back(arg);
     }
+    if (paths.size() != 2) throw std::invalid_argument("--strips needs an input and an output file");
 
-    return image;
+    StripReport report = StripProcessor(Pipeline::parse(ops), options).run(paths[0], paths[1]);
+    std::cout << "Processed in " << report.passes << " pass(es), " << report.strips
+              << " strips of up to " << report.stripRows << " rows on " << report.threads << " thread(s)\n";
+    return 0;
 }
 
-int main() {
+int main(int argc, char** argv) {
     try {
-        std::string imagePath = "example.jpeg";
-        
-        // Load image using OpenCV
-        cv::Mat img = cv::imread(imagePath);
-        if (img.empty()) {
-            throw std::runtime_error("Failed to load image: " + imagePath);
+        if (argc > 1) {
+            std::string first = argv[1];
+            if (first == "-h" || first == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            }
+            if (first == "--strips") return runStrips(argc, argv);
+            return runBatch(argc, argv);
         }
 
-        // Convert to custom Image class
+        std::string imagePath = "example.jpeg";
+
+        // Load image using OpenCV; the Image takes over the decoded pixels
         Image myImage = convertToImageClass(imagePath);
 
         // Perform operations
@@ -52,27 +114,12 @@ int main() {
 
         std::cout << "Image processed successfully!\n";
 
-        cv::Mat processedImg;
-        if (myImage.getChannels() == 1) {
-            processedImg = cv::Mat(myImage.getHeight(), myImage.getWidth(), CV_8UC1);
-            for (int y = 0; y < myImage.getHeight(); y++) {
-                for (int x = 0; x < myImage.getWidth(); x++) {
-                    processedImg.at<uint8_t>(y, x) = myImage.at(y, x, 0);
-                }
-            }
-        } else {
-            processedImg = cv::Mat(myImage.getHeight(), myImage.getWidth(), CV_8UC3);
-            for (int y = 0; y < myImage.getHeight(); y++) {
-                for (int x = 0; x < myImage.getWidth(); x++) {
-                    for (int c = 0; c < myImage.getChannels(); c++) {
-                        processedImg.at<cv::Vec3b>(y, x)[c] = myImage.at(y, x, c);
-                    }
-                }
-            }
-        }
-
         // Save processed image
-        cv::imwrite("processed_image.jpeg", processedImg);
+        saveImage(myImage, "processed_image.jpeg");
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        printUsage(argv[0]);
+        return 2;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << '\n';
         return 1;
@@ -80,8 +127,3 @@ int main() {
 
     return 0;
 }
-
-
-
-
-
@@ -0,0 +1,284 @@
+// batch_processor.hpp
+#ifndef BATCH_PROCESSOR_H
+#define BATCH_PROCESSOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "opencv_interop.hpp"
+#include "pipeline.hpp"
+
+
+// Runs one Pipeline over many files as three overlapping stages:
+//
+//   decode (read + imdecode) -> process (Pipeline) -> encode (imencode + write)
+//
+// Each stage has its own workers and the stages are joined by bounded queues,
+// so file I/O and JPEG coding of some images overlap with processing of
+// others and memory stays at roughly queueDepth images per queue.
+struct BatchOptions {
+    std::vector<std::string> inputs;
+    std::string outputDir = "processed";
+    std::string outputExtension; // e.g. ".png"; empty keeps the input's
+    Pipeline pipeline;
+    int decodeWorkers = 0;  // 0 = half the hardware threads
+    int processWorkers = 0; // 0 = 2; each image is already split across the thread pool
+    int encodeWorkers = 0;  // 0 = half the hardware threads
+    size_t queueDepth = 8;
+};
+
+struct StageStats {
+    std::string name;
+    int workers = 0;
+    size_t items = 0;
+    double busySeconds = 0; // Summed over the stage's workers
+
+    // Share of the stage's worker time spent working rather than waiting
+    double utilisation(double wallSeconds) const {
+        return wallSeconds > 0 && workers > 0 ? busySeconds / (wallSeconds * workers) : 0.0;
+    }
+};
+
+struct BatchReport {
+    size_t images = 0; // Written successfully
+    size_t failed = 0;
+    double seconds = 0;
+    std::vector<StageStats> stages;
+
+    double imagesPerSecond() const { return seconds > 0 ? images / seconds : 0.0; }
+
+    void print(std::ostream& out) const {
+        out << images << " images in " << seconds << " s (" << imagesPerSecond() << " images/s)";
+        if (failed) out << ", " << failed << " failed";
+        out << '\n';
+        for (const StageStats& stage : stages) {
+            out << "  " << stage.name << ": " << stage.workers << " workers, "
+                << stage.items << " items, "
+                << static_cast<int>(stage.utilisation(seconds) * 100 + 0.5) << "% busy\n";
+        }
+    }
+};
+
+
+// Expands a directory into the image files in it (sorted), a .txt/.lst file
+// into the paths it lists one per line, and passes anything else through
+inline std::vector<std::string> collectInputs(const std::vector<std::string>& args) {
+    namespace fs = std::filesystem;
+    static const char* imageExtensions[] = {
+        ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".webp", ".ppm", ".pgm"
+    };
+    auto lower = [](std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+        return s;
+    };
+
+    std::vector<std::string> files;
+    for (const std::string& arg : args) {
+        fs::path path(arg);
+        std::string ext = lower(path.extension().string());
+        if (fs::is_directory(path)) {
+            std::vector<std::string> found;
+            for (const auto& entry : fs::directory_iterator(path)) {
+                std::string entryExt = lower(entry.path().extension().string());
+                if (entry.is_regular_file() &&
+                    std::find(std::begin(imageExtensions), std::end(imageExtensions), entryExt) !=
+                        std::end(imageExtensions)) {
+                    found.push_back(entry.path().string());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else if (ext == ".txt" || ext == ".lst") {
+            std::ifstream list(path);
+            if (!list) throw std::runtime_error("Failed to open file list: " + arg);
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty()) files.push_back(line);
+            }
+        } else {
+            files.push_back(arg);
+        }
+    }
+    return files;
+}
+
+
+class BatchProcessor {
+public:
+    explicit BatchProcessor(BatchOptions options) : options(std::move(options)) {
+        const int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        auto orDefault = [](int workers, int fallback) { return workers > 0 ? workers : fallback; };
+        this->options.decodeWorkers = orDefault(this->options.decodeWorkers, std::max(1, hardware / 2));
+        this->options.processWorkers = orDefault(this->options.processWorkers, 2);
+        this->options.encodeWorkers = orDefault(this->options.encodeWorkers, std::max(1, hardware / 2));
+    }
+
+    // Throws std::invalid_argument before any work if two inputs would be
+    // written to the same file, see outputPaths()
+    BatchReport run() {
+        const std::vector<std::filesystem::path> outputs = outputPaths();
+        std::filesystem::create_directories(options.outputDir);
+        for (const auto& output : outputs) std::filesystem::create_directories(output.parent_path());
+
+        BoundedQueue<Item> decoded(options.queueDepth);
+        BoundedQueue<Item> processed(options.queueDepth);
+        std::atomic<size_t> nextInput{0};
+        Stage decode{"decode", options.decodeWorkers};
+        Stage process{"process", options.processWorkers};
+        Stage encode{"encode", options.encodeWorkers};
+
+        const auto start = Clock::now();
+
+        std::vector<std::thread> threads;
+        launch(threads, decode, decoded, [&] {
+            for (size_t i = nextInput++; i < options.inputs.size(); i = nextInput++) {
+                Item item{i, Image(0, 0, 1)};
+                if (!decode.timed([&] { item.image = convertToImageClass(options.inputs[i]); })) continue;
+                if (!decoded.push(std::move(item))) return;
+            }
+        });
+        launch(threads, process, processed, [&] {
+            while (auto item = decoded.pop()) {
+                if (!process.timed([&] { options.pipeline.execute(item->image); })) continue;
+                if (!processed.push(std::move(*item))) return;
+            }
+        });
+        launch(threads, encode, [&] {
+            while (auto item = processed.pop()) {
+                encode.timed([&] { saveImage(item->image, outputs[item->index].string()); });
+            }
+        });
+        for (std::thread& thread : threads) thread.join();
+
+        BatchReport report;
+        report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        report.failed = decode.failed + process.failed + encode.failed;
+        report.images = encode.items - encode.failed;
+        for (Stage* stage : {&decode, &process, &encode}) {
+            report.stages.push_back(stage->stats());
+        }
+        return report;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Item {
+        size_t index; // Into options.inputs
+        Image image;
+    };
+
+    struct Stage {
+        Stage(const char* name, int workers) : name(name), workers(workers) {}
+
+        const char* name;
+        int workers;
+        std::atomic<int> running{0};
+        std::atomic<size_t> items{0};
+        std::atomic<size_t> failed{0};
+        std::atomic<long long> busyNanos{0};
+
+        // Runs one unit of work, counting its time; failures are reported and skipped
+        bool timed(const std::function<void()>& work) {
+            const auto begin = Clock::now();
+            bool ok = true;
+            try {
+                work();
+            } catch (const std::exception& e) {
+                static std::mutex logMutex;
+                std::lock_guard<std::mutex> lock(logMutex);
+                std::cerr << name << " failed: " << e.what() << '\n';
+                ok = false;
+                failed++;
+            }
+            busyNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+            items++;
+            return ok;
+        }
+
+        StageStats stats() const {
+            StageStats s;
+            s.name = name;
+            s.workers = workers;
+            s.items = items;
+            s.busySeconds = busyNanos * 1e-9;
+            return s;
+        }
+    };
+
+    BatchOptions options;
+
+    // Starts the stage's workers; the last one to finish closes `output` so
+    // the next stage drains and stops
+    static void launch(std::vector<std::thread>& threads, Stage& stage, BoundedQueue<Item>& output,
+                       const std::function<void()>& body) {
+        stage.running = stage.workers;
+        for (int i = 0; i < stage.workers; i++) {
+            threads.emplace_back([&stage, &output, body] {
+                body();
+                if (--stage.running == 0) output.close();
+            });
+        }
+    }
+
+    static void launch(std::vector<std::thread>& threads, Stage& stage, const std::function<void()>& body) {
+        for (int i = 0; i < stage.workers; i++) threads.emplace_back(body);
+    }
+
+    // Each input's path relative to the deepest directory holding all of
+    // them, under outputDir, so files of the same name from different
+    // directories stay apart (a single directory keeps the flat layout).
+    // Inputs that would still share an output, the same file listed twice or
+    // names that only differ in the replaced extension, are an error.
+    std::vector<std::filesystem::path> outputPaths() const {
+        namespace fs = std::filesystem;
+        std::vector<fs::path> sources;
+        sources.reserve(options.inputs.size());
+        for (const std::string& input : options.inputs) {
+            sources.push_back(fs::absolute(input).lexically_normal());
+        }
+
+        fs::path root = sources.empty() ? fs::path() : sources.front().parent_path();
+        for (const fs::path& source : sources) {
+            while (std::mismatch(root.begin(), root.end(), source.begin(), source.end()).first != root.end()) {
+                if (root == root.parent_path()) { // Different drives: nothing in common
+                    root.clear();
+                    break;
+                }
+                root = root.parent_path();
+            }
+        }
+
+        std::vector<fs::path> outputs;
+        std::map<fs::path, size_t> owners; // Output -> index of the input writing it
+        for (size_t i = 0; i < sources.size(); i++) {
+            fs::path relative = sources[i].lexically_relative(root);
+            if (relative.empty()) relative = sources[i].filename();
+            if (!options.outputExtension.empty()) relative.replace_extension(options.outputExtension);
+            fs::path output = fs::path(options.outputDir) / relative;
+            auto inserted = owners.emplace(output, i);
+            if (!inserted.second) {
+                throw std::invalid_argument("Inputs " + options.inputs[inserted.first->second] + " and " +
+                                            options.inputs[i] + " would both be written to " + output.string());
+            }
+            outputs.push_back(std::move(output));
+        }
+        return outputs;
+    }
+};
+
+#endif // BATCH_PROCESSOR_H
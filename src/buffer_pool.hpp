@@ -0,0 +1,154 @@
+// buffer_pool.hpp
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "image_view.hpp"
+
+
+// Aligned pixel buffers kept for reuse. Every operation that writes into a
+// second buffer swaps it in and drops the old one; with the pool, that old
+// buffer is what the next operation (or the next request) takes, instead of
+// a fresh allocation. Buffers are grouped into size classes so images of
+// nearly the same size share them. Free buffers are capped at `capacity`
+// bytes; IMAGE_BUFFER_POOL_MB (default 256) sets it for the shared pool, and
+// 0 turns pooling off.
+class BufferPool {
+public:
+    explicit BufferPool(size_t capacity) : capacity(capacity) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Never destroyed, so images in static storage can still hand their
+    // buffers back during shutdown
+    static BufferPool& shared() {
+        static BufferPool* pool = new BufferPool(capacityFromEnvironment());
+        return *pool;
+    }
+
+    // A buffer of at least `bytes` bytes, aligned like allocateAligned();
+    // it goes back to the pool when the last reference is dropped
+    std::shared_ptr<uint8_t> acquire(size_t bytes) {
+        if (bytes == 0) return nullptr;
+        const size_t size = classSize(bytes);
+        AlignedBuffer buffer;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = free.find(size);
+            if (it != free.end()) {
+                buffer = std::move(it->second.back());
+                it->second.pop_back();
+                if (it->second.empty()) free.erase(it);
+                held -= size;
+            }
+        }
+        if (buffer) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            buffer = allocateAligned(size);
+        }
+        uint8_t* pixels = buffer.release();
+        return std::shared_ptr<uint8_t>(pixels, Return{this, size});
+    }
+
+    // Frees every buffer the pool holds
+    void trim() {
+        std::map<size_t, std::vector<AlignedBuffer>> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dropped.swap(free);
+            held = 0;
+        }
+    }
+
+    size_t bytesHeld() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return held;
+    }
+
+    size_t capacityBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return capacity;
+    }
+
+    // Changes the cap on free buffers, freeing the largest ones over it
+    void setCapacity(size_t bytes) {
+        std::vector<AlignedBuffer> evicted;
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = bytes;
+        evictDownTo(capacity, evicted);
+    }
+
+    uint64_t hitCount() const { return hits.load(std::memory_order_relaxed); }
+    uint64_t missCount() const { return misses.load(std::memory_order_relaxed); }
+
+    // Four classes per power of two above 4 KiB, so a buffer is at most a
+    // quarter larger than asked for
+    static size_t classSize(size_t bytes) {
+        constexpr size_t kMinClass = 4096;
+        if (bytes <= kMinClass) return kMinClass;
+        const size_t last = bytes - 1;
+        int top = 0;
+        while ((last >> top) > 1) top++;
+        const size_t step = size_t(1) << (top - 2);
+        return (last / step + 1) * step;
+    }
+
+private:
+    struct Return {
+        BufferPool* pool;
+        size_t size;
+
+        void operator()(uint8_t* pixels) const { pool->release(AlignedBuffer(pixels, AlignedDeleter{size}), size); }
+    };
+
+    size_t capacity; // Guarded by mutex
+    mutable std::mutex mutex;
+    std::map<size_t, std::vector<AlignedBuffer>> free; // By class size, no empty entries
+    size_t held = 0;
+    std::atomic<uint64_t> hits{0}, misses{0};
+
+    void release(AlignedBuffer buffer, size_t size) {
+        // Evicted buffers are freed after the lock is released
+        std::vector<AlignedBuffer> evicted;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size > capacity) return;
+        evictDownTo(capacity - size, evicted);
+        free[size].push_back(std::move(buffer));
+        held += size;
+    }
+
+    // Drops the largest free buffers first until at most `bytes` are held:
+    // they return the most memory, and are the least likely to fit the next
+    // request. Called with the lock held.
+    void evictDownTo(size_t bytes, std::vector<AlignedBuffer>& evicted) {
+        while (held > bytes) {
+            auto largest = std::prev(free.end());
+            evicted.push_back(std::move(largest->second.back()));
+            largest->second.pop_back();
+            held -= largest->first;
+            if (largest->second.empty()) free.erase(largest);
+        }
+    }
+
+    static size_t capacityFromEnvironment() {
+        if (const char* mb = std::getenv("IMAGE_BUFFER_POOL_MB")) {
+            long value = std::atol(mb);
+            if (value >= 0) return static_cast<size_t>(value) << 20;
+        }
+        return size_t(256) << 20;
+    }
+};
+
+#endif // BUFFER_POOL_H
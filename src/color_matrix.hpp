@@ -0,0 +1,191 @@
+// color_matrix.hpp
+#ifndef COLOR_MATRIX_H
+#define COLOR_MATRIX_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "pixel_format.hpp"
+
+
+// A linear map of a pixel's red, green and blue, wherever its PixelFormat
+// stores them; alpha passes through. Saturation, sepia, hue rotation, channel
+// mixing and grayscale are all such maps, and any chain of them composes
+// into one matrix, so the chain costs one pass over the image.
+//
+//   ColorMatrix grade = ColorMatrix::saturation(0.8f)
+//                           .then(ColorMatrix::hueRotate(15))
+//                           .then(ColorMatrix::sepia());
+//   image.applyColorMatrix(grade);
+//
+// Pixels are transformed in 14-bit fixed point and truncated like the float
+// code this replaced, so single operations match it to within 1. A composed
+// matrix clips only once, at the end; the pipeline only composes where the
+// earlier steps cannot clip (see staysInRange()).
+class ColorMatrix {
+public:
+    // Row-major over (R, G, B): out[i] = sum over j of m[3 * i + j] * in[j]
+    using Coefficients = std::array<float, 9>;
+
+    static constexpr int kFractionBits = 14;
+    // Coefficients are clamped to this, which keeps the 32-bit sums from overflowing
+    static constexpr float kMaxCoefficient = 128.0f;
+
+    // Identity
+    ColorMatrix() : ColorMatrix(Coefficients{1, 0, 0, 0, 1, 0, 0, 0, 1}) {}
+
+    explicit ColorMatrix(const Coefficients& coefficients) : m(coefficients) {
+        for (int i = 0; i < 9; i++) {
+            m[i] = std::clamp(m[i], -kMaxCoefficient, kMaxCoefficient);
+            fixed[i] = static_cast<int32_t>(std::lround(m[i] * (1 << kFractionBits)));
+        }
+    }
+
+    // Luminance weights (ITU-R BT.601), as used by grayscale and saturation
+    static constexpr float kLumaR = 0.299f, kLumaG = 0.587f, kLumaB = 0.114f;
+
+    // Every channel set to luminance
+    static ColorMatrix grayscale() {
+        return ColorMatrix({kLumaR, kLumaG, kLumaB, kLumaR, kLumaG, kLumaB, kLumaR, kLumaG, kLumaB});
+    }
+
+    // gray + (c - gray) * factor: 0 is grayscale, 1 the identity
+    static ColorMatrix saturation(float factor) {
+        const float l[3] = {kLumaR, kLumaG, kLumaB};
+        Coefficients c;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) c[3 * i + j] = (1 - factor) * l[j] + (i == j ? factor : 0.0f);
+        }
+        return ColorMatrix(c);
+    }
+
+    static ColorMatrix sepia() {
+        return ColorMatrix({0.393f, 0.769f, 0.189f,
+                            0.349f, 0.686f, 0.168f,
+                            0.272f, 0.534f, 0.131f});
+    }
+
+    // Rotation of hue around the luminance axis, in degrees (the CSS hue-rotate() matrix)
+    static ColorMatrix hueRotate(float degrees) {
+        const float radians = degrees * 3.14159265358979f / 180.0f;
+        const float c = std::cos(radians), s = std::sin(radians);
+        return ColorMatrix({0.213f + c * 0.787f - s * 0.213f, 0.715f - c * 0.715f - s * 0.715f, 0.072f - c * 0.072f + s * 0.928f,
+                            0.213f - c * 0.213f + s * 0.143f, 0.715f + c * 0.285f + s * 0.140f, 0.072f - c * 0.072f - s * 0.283f,
+                            0.213f - c * 0.213f - s * 0.787f, 0.715f - c * 0.715f + s * 0.715f, 0.072f + c * 0.928f + s * 0.072f});
+    }
+
+    // Each output colour as a weighted sum of the inputs, e.g. swapping red
+    // and blue is {0, 0, 1, 0, 1, 0, 1, 0, 0}
+    static ColorMatrix channelMix(const Coefficients& coefficients) {
+        return ColorMatrix(coefficients);
+    }
+
+    // This matrix followed by `next`
+    ColorMatrix then(const ColorMatrix& next) const {
+        Coefficients c;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                c[3 * i + j] = next.m[3 * i] * m[j] + next.m[3 * i + 1] * m[3 + j] + next.m[3 * i + 2] * m[6 + j];
+            }
+        }
+        return ColorMatrix(c);
+    }
+
+    // True when no input can map outside [0, 255]: no negative weights and
+    // no row adding up to more than 1. A step like this composes with the
+    // next one without clipping in between, so the composed matrix only
+    // skips the truncation the separate steps would do.
+    bool staysInRange() const {
+        for (int i = 0; i < 3; i++) {
+            if (m[3 * i] < 0 || m[3 * i + 1] < 0 || m[3 * i + 2] < 0) return false;
+            if (m[3 * i] + m[3 * i + 1] + m[3 * i + 2] > 1.0001f) return false;
+        }
+        return true;
+    }
+
+    const Coefficients& coefficients() const { return m; }
+
+    // Transforms `width` pixels in place. Pixels are split into R, G and B
+    // planes a chunk at a time, so the arithmetic runs on contiguous int32
+    // lanes the compiler can vectorise. Gray layouts are left alone.
+    template <typename Layout>
+    void applyRow(uint8_t* p, int width) const {
+        if constexpr (isColourLayout<Layout>()) {
+            constexpr int channels = Layout::channels;
+            constexpr int offsets[3] = {Layout::red, Layout::green, Layout::blue};
+            int32_t planes[3][kChunk];
+            uint8_t out[kChunk];
+            for (int x0 = 0; x0 < width; x0 += kChunk) {
+                const int n = std::min(kChunk, width - x0);
+                uint8_t* px = p + static_cast<size_t>(x0) * channels;
+                split<Layout>(px, n, planes);
+                for (int i = 0; i < 3; i++) {
+                    transform(planes, n, i, out);
+                    for (int x = 0; x < n; x++) px[x * channels + offsets[i]] = out[x];
+                }
+            }
+        }
+    }
+
+    void applyRow(uint8_t* p, int width, PixelFormat format) const {
+        withPixelLayout(format, [&](auto layout) { applyRow<decltype(layout)>(p, width); });
+    }
+
+    // Writes output red of each pixel of `in` to the single-channel row `out`
+    // (with grayscale(), the luminance); a gray row is copied as it is
+    template <typename Layout>
+    void applyRowToGray(const uint8_t* in, uint8_t* out, int width) const {
+        if constexpr (isColourLayout<Layout>()) {
+            int32_t planes[3][kChunk];
+            for (int x0 = 0; x0 < width; x0 += kChunk) {
+                const int n = std::min(kChunk, width - x0);
+                split<Layout>(in + static_cast<size_t>(x0) * Layout::channels, n, planes);
+                transform(planes, n, 0, out + x0);
+            }
+        } else {
+            for (int x = 0; x < width; x++) out[x] = in[x * Layout::channels];
+        }
+    }
+
+    void applyRowToGray(const uint8_t* in, uint8_t* out, int width, PixelFormat format) const {
+        withPixelLayout(format, [&](auto layout) { applyRowToGray<decltype(layout)>(in, out, width); });
+    }
+
+private:
+    static constexpr int kChunk = 64;
+
+    Coefficients m;
+    std::array<int32_t, 9> fixed;
+
+    // R, G and B of n pixels; the lanes past n are zeroed so the full-chunk
+    // loops read defined values
+    template <typename Layout>
+    static void split(const uint8_t* px, int n, int32_t (&planes)[3][kChunk]) {
+        constexpr int channels = Layout::channels;
+        for (int x = 0; x < n; x++) {
+            planes[0][x] = px[x * channels + Layout::red];
+            planes[1][x] = px[x * channels + Layout::green];
+            planes[2][x] = px[x * channels + Layout::blue];
+        }
+        for (int x = n; x < kChunk; x++) planes[0][x] = planes[1][x] = planes[2][x] = 0;
+    }
+
+    // Output colour `i` (0 = R) for n pixels; the shift floors, which matches the
+    // float code's truncation wherever the result is not clipped to 0 anyway.
+    // The loop always runs the full chunk: a fixed trip count is what lets
+    // -O2 vectorise it.
+    void transform(const int32_t (&planes)[3][kChunk], int n, int i, uint8_t* out) const {
+        const int32_t m0 = fixed[3 * i], m1 = fixed[3 * i + 1], m2 = fixed[3 * i + 2];
+        uint8_t values[kChunk];
+        for (int x = 0; x < kChunk; x++) {
+            int32_t v = (m0 * planes[0][x] + m1 * planes[1][x] + m2 * planes[2][x]) >> kFractionBits;
+            values[x] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+        }
+        std::memcpy(out, values, n);
+    }
+};
+
+#endif // COLOR_MATRIX_H
@@ -0,0 +1,101 @@
+// compute_pool.hpp
+#ifndef COMPUTE_POOL_H
+#define COMPUTE_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+
+
+struct ComputePoolOptions {
+    int threads = 2;           // Requests processed at once; each still fans out over the shared pool
+    size_t queueCapacity = 64; // Requests waiting beyond that are turned away
+
+    // IMAGE_COMPUTE_THREADS and IMAGE_COMPUTE_QUEUE override the defaults
+    static ComputePoolOptions fromEnvironment() {
+        ComputePoolOptions options;
+        if (const char* threads = std::getenv("IMAGE_COMPUTE_THREADS")) {
+            options.threads = std::max(1, std::atoi(threads));
+        }
+        if (const char* queue = std::getenv("IMAGE_COMPUTE_QUEUE")) {
+            options.queueCapacity = static_cast<size_t>(std::max(1, std::atoi(queue)));
+        }
+        return options;
+    }
+};
+
+// Runs CPU-heavy request work on its own threads behind a bounded admission
+// queue, so the server's I/O threads only parse and respond. When the queue
+// is full, trySubmit() fails at once and the caller can shed the request
+// (503 with retryAfterSeconds()) rather than let every queue grow.
+class ComputePool {
+public:
+    explicit ComputePool(const ComputePoolOptions& options = ComputePoolOptions::fromEnvironment())
+        : queue(options.queueCapacity) {
+        for (int i = 0; i < std::max(1, options.threads); i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    // Finishes the queued tasks, then joins
+    ~ComputePool() {
+        queue.close();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    ComputePool(const ComputePool&) = delete;
+    ComputePool& operator=(const ComputePool&) = delete;
+
+    // Queues `task`, or returns false without running it when the queue is full
+    bool trySubmit(std::function<void()> task) {
+        if (!queue.tryPush(std::move(task))) {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Rough wait for a new request: queued tasks times the recent average
+    // task time, spread over the threads. At least one second.
+    int retryAfterSeconds() const {
+        const double average = averageMicros.load(std::memory_order_relaxed) * 1e-6;
+        const double wait = static_cast<double>(queue.size()) * average / workers.size();
+        return std::max(1, static_cast<int>(std::ceil(wait)));
+    }
+
+    size_t queued() const { return queue.size(); }
+    int threads() const { return static_cast<int>(workers.size()); }
+    uint64_t rejectedCount() const { return rejected.load(std::memory_order_relaxed); }
+
+private:
+    BoundedQueue<std::function<void()>> queue;
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> averageMicros{0}; // Moving average, new samples weigh 1/8
+
+    void workerLoop() {
+        while (std::optional<std::function<void()>> task = queue.pop()) {
+            const auto start = std::chrono::steady_clock::now();
+            try {
+                (*task)();
+            } catch (...) {
+                // Tasks answer their own errors; one that escapes must not end the worker
+            }
+            const uint64_t micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+            const uint64_t average = averageMicros.load(std::memory_order_relaxed);
+            averageMicros.store(average ? average - average / 8 + micros / 8 : micros, std::memory_order_relaxed);
+        }
+    }
+};
+
+#endif // COMPUTE_POOL_H
@@ -0,0 +1,274 @@
+// edge_detection.hpp
+#ifndef EDGE_DETECTION_H
+#define EDGE_DETECTION_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include "image_view.hpp"
+#include "color_matrix.hpp"
+
+
+enum class EdgeKernel { Sobel, Scharr };
+enum class EdgeNorm { L2, L1 }; // sqrt(gx^2 + gy^2) or |gx| + |gy|
+
+struct EdgeOptions {
+    EdgeKernel kernel = EdgeKernel::Sobel;
+    EdgeNorm norm = EdgeNorm::L2;
+    bool luminance = false; // Colour input gives one channel, the edges of its luminance
+
+    // Packed form used as the pipeline's "detectedge" value:
+    // 1 = Scharr, 2 = L1, 4 = luminance; 0 is plain per-channel Sobel
+    static EdgeOptions fromFlags(int flags) {
+        EdgeOptions options;
+        options.kernel = flags & 1 ? EdgeKernel::Scharr : EdgeKernel::Sobel;
+        options.norm = flags & 2 ? EdgeNorm::L1 : EdgeNorm::L2;
+        options.luminance = (flags & 4) != 0;
+        return options;
+    }
+
+    int flags() const {
+        return (kernel == EdgeKernel::Scharr ? 1 : 0) | (norm == EdgeNorm::L1 ? 2 : 0) | (luminance ? 4 : 0);
+    }
+};
+
+
+// Separable 3x3 gradients in 16-bit integers, one output row at a time. Both
+// kernels are a smoothing [side centre side] across the derivative [-1 0 1];
+// Scharr's weights add up to 16 instead of 4, so its magnitudes are divided
+// by 4 (`shift`) to land in Sobel's range. Rows and columns outside the image
+// repeat the edge pixels. With luminance, colour rows are converted once and
+// kept in a 3-row ring, so the output has one channel; `singleChannel` also
+// reduces gray + alpha to its gray, for callers whose output is always one
+// channel.
+class GradientRows {
+public:
+    GradientRows(ConstImageView src, EdgeKernel kernel, bool luminance, bool singleChannel = false)
+        : src(src), luminance((luminance && src.channels >= 3) || (singleChannel && src.channels > 1)),
+          channels(this->luminance ? 1 : src.channels),
+          side(kernel == EdgeKernel::Scharr ? 3 : 1), centre(kernel == EdgeKernel::Scharr ? 10 : 2),
+          shift(kernel == EdgeKernel::Scharr ? 2 : 0),
+          smooth((src.width + 2) * channels), diff((src.width + 2) * channels),
+          gray(this->luminance ? 3 * static_cast<size_t>(src.width) : 0) {}
+
+    int outputChannels() const { return channels; }
+    int magnitudeShift() const { return shift; }
+
+    // gx and gy of row y, width * outputChannels() values each
+    void compute(int y, int16_t* gx, int16_t* gy) {
+        const int n = src.width * channels;
+        const uint8_t* top = sourceRow(y - 1);
+        const uint8_t* mid = sourceRow(y);
+        const uint8_t* bottom = sourceRow(y + 1);
+
+        int16_t* s = smooth.data() + channels;
+        int16_t* d = diff.data() + channels;
+        for (int i = 0; i < n; i++) {
+            s[i] = static_cast<int16_t>(side * (top[i] + bottom[i]) + centre * mid[i]);
+            d[i] = static_cast<int16_t>(bottom[i] - top[i]);
+        }
+        for (int c = 0; c < channels; c++) {
+            s[c - channels] = s[c];
+            s[n + c] = s[n - channels + c];
+            d[c - channels] = d[c];
+            d[n + c] = d[n - channels + c];
+        }
+        for (int i = 0; i < n; i++) {
+            gx[i] = static_cast<int16_t>(s[i + channels] - s[i - channels]);
+            gy[i] = static_cast<int16_t>(side * (d[i - channels] + d[i + channels]) + centre * d[i]);
+        }
+    }
+
+private:
+    ConstImageView src;
+    const bool luminance;
+    const int channels;
+    const int side, centre, shift;
+    std::vector<int16_t> smooth, diff; // One replicated pixel on each side
+    std::vector<uint8_t> gray;
+    int grayRow[3] = {-1, -1, -1};
+
+    const uint8_t* sourceRow(int y) {
+        y = std::clamp(y, 0, src.height - 1);
+        if (!luminance) return src.row(y);
+        // Three consecutive rows always land in different slots
+        const int slot = y % 3;
+        uint8_t* row = gray.data() + static_cast<size_t>(slot) * src.width;
+        if (grayRow[slot] != y) {
+            ColorMatrix::grayscale().applyRowToGray(src.row(y), row, src.width, src.format);
+            grayRow[slot] = y;
+        }
+        return row;
+    }
+};
+
+// floor(sqrt(m)) for every m below 255^2; larger magnitudes saturate. Exact,
+// so the L2 Sobel output matches the float version byte for byte.
+inline const std::array<uint8_t, 255 * 255>& sqrtTable() {
+    static const std::array<uint8_t, 255 * 255> table = [] {
+        std::array<uint8_t, 255 * 255> t{};
+        int root = 0;
+        for (int m = 0; m < 255 * 255; m++) {
+            while ((root + 1) * (root + 1) <= m) root++;
+            t[m] = static_cast<uint8_t>(root);
+        }
+        return t;
+    }();
+    return table;
+}
+
+// Gradient magnitude for rows [y0, y1) of dst, which has
+// GradientRows::outputChannels() channels; reads one row above and below
+inline void edgeRows(ConstImageView src, ImageView dst, const EdgeOptions& options, int y0, int y1) {
+    if (src.width == 0) return;
+    GradientRows gradients(src, options.kernel, options.luminance);
+    const int n = src.width * gradients.outputChannels();
+    const int shift = gradients.magnitudeShift();
+    std::vector<int16_t> gx(n), gy(n);
+    std::vector<int32_t> magnitude(n);
+    const std::array<uint8_t, 255 * 255>& roots = sqrtTable();
+    // Alpha is carried over rather than differentiated
+    const int channels = gradients.outputChannels();
+    const int alpha = channels == src.channels && hasAlpha(src.format) ? channels - 1 : -1;
+
+    for (int y = y0; y < y1; y++) {
+        gradients.compute(y, gx.data(), gy.data());
+        uint8_t* out = dst.row(y);
+        if (options.norm == EdgeNorm::L1) {
+            for (int i = 0; i < n; i++) {
+                int32_t m = (std::abs(gx[i]) + std::abs(gy[i])) >> shift;
+                out[i] = static_cast<uint8_t>(std::min(m, 255));
+            }
+        } else {
+            // Squares in one vectorisable loop, roots by table in a second
+            for (int i = 0; i < n; i++) {
+                magnitude[i] = (gx[i] * gx[i] + gy[i] * gy[i]) >> (2 * shift);
+            }
+            for (int i = 0; i < n; i++) {
+                out[i] = magnitude[i] < 255 * 255 ? roots[magnitude[i]] : 255;
+            }
+        }
+        if (alpha >= 0) {
+            const uint8_t* in = src.row(y);
+            for (int i = alpha; i < n; i += channels) out[i] = in[i];
+        }
+    }
+}
+
+
+// Largest Canny threshold accepted from requests; well above any Sobel or
+// Scharr magnitude, and small enough that its square fits the int64 compare
+constexpr float kMaxCannyThreshold = 10000.0f;
+
+// Canny, step one: non-maximum suppression and double thresholding of the
+// luminance gradient for rows [y0, y1) of the single-channel dst. Pixels
+// become 255 (strong), 128 (weak) or 0. `low` and `high` are magnitudes in
+// Sobel units. Reads two rows above and below; run cannyHysteresis() on the
+// whole map afterwards.
+inline void cannyClassifyRows(ConstImageView src, ImageView dst, const EdgeOptions& options,
+                              float low, float high, int y0, int y1) {
+    const int width = src.width;
+    if (width == 0) return;
+    GradientRows gradients(src, options.kernel, true, true);
+    const int scale = 1 << gradients.magnitudeShift();
+    const bool l2 = options.norm == EdgeNorm::L2;
+    // Compared against squared magnitudes for L2, so no roots are taken
+    auto threshold = [&](float t) -> int64_t {
+        const double v = std::max(0.0, static_cast<double>(t)) * scale;
+        return l2 ? static_cast<int64_t>(v * v) : static_cast<int64_t>(v);
+    };
+    const int64_t lowT = threshold(low), highT = threshold(high);
+
+    // Magnitude and direction of rows y - 1, y, y + 1, with a zero column on
+    // each side; rows outside the image are all zero
+    std::vector<int32_t> magnitude[3];
+    std::vector<uint8_t> direction[3];
+    int rowOf[3] = {INT32_MIN, INT32_MIN, INT32_MIN};
+    for (int i = 0; i < 3; i++) {
+        magnitude[i].assign(width + 2, 0);
+        direction[i].assign(width, 0);
+    }
+    std::vector<int16_t> gx(width), gy(width);
+
+    // 0: gradient along x, compare left/right; 1: along y; 2: down-right
+    // diagonal; 3: down-left diagonal. tan(22.5) and tan(67.5) in Q15.
+    auto load = [&](int y) -> int {
+        const int slot = ((y % 3) + 3) % 3;
+        if (rowOf[slot] == y) return slot;
+        rowOf[slot] = y;
+        int32_t* m = magnitude[slot].data() + 1;
+        if (y < 0 || y >= src.height) {
+            std::fill(m, m + width, 0);
+            return slot;
+        }
+        gradients.compute(y, gx.data(), gy.data());
+        uint8_t* dir = direction[slot].data();
+        for (int x = 0; x < width; x++) {
+            const int32_t ax = std::abs(gx[x]), ay = std::abs(gy[x]);
+            m[x] = l2 ? ax * ax + ay * ay : ax + ay;
+            if ((ay << 15) <= ax * 13573) dir[x] = 0;
+            else if ((ay << 15) >= ax * 79109) dir[x] = 1;
+            else dir[x] = (gx[x] ^ gy[x]) >= 0 ? 2 : 3;
+        }
+        return slot;
+    };
+
+    for (int y = y0; y < y1; y++) {
+        const int32_t* above = magnitude[load(y - 1)].data() + 1;
+        const int32_t* below = magnitude[load(y + 1)].data() + 1;
+        const int here = load(y);
+        const int32_t* m = magnitude[here].data() + 1;
+        const uint8_t* dir = direction[here].data();
+        uint8_t* out = dst.row(y);
+        for (int x = 0; x < width; x++) {
+            const int32_t v = m[x];
+            if (v <= lowT) { out[x] = 0; continue; }
+            // Strictly greater than the neighbour before, at least the one after,
+            // so a plateau two pixels wide yields one edge
+            bool peak;
+            switch (dir[x]) {
+                case 0: peak = v > m[x - 1] && v >= m[x + 1]; break;
+                case 1: peak = v > above[x] && v >= below[x]; break;
+                case 2: peak = v > above[x - 1] && v >= below[x + 1]; break;
+                default: peak = v > above[x + 1] && v >= below[x - 1]; break;
+            }
+            out[x] = !peak ? 0 : (v > highT ? 255 : 128);
+        }
+    }
+}
+
+// Canny, step two: keeps weak pixels 8-connected to a strong one and clears
+// the rest, leaving a 0/255 map. Flood fill over the whole image, so serial.
+inline void cannyHysteresis(ImageView map) {
+    std::vector<std::pair<int, int>> stack;
+    for (int y = 0; y < map.height; y++) {
+        const uint8_t* row = map.row(y);
+        for (int x = 0; x < map.width; x++) {
+            if (row[x] == 255) stack.emplace_back(x, y);
+        }
+    }
+    while (!stack.empty()) {
+        const auto [x, y] = stack.back();
+        stack.pop_back();
+        for (int ny = std::max(0, y - 1); ny <= std::min(map.height - 1, y + 1); ny++) {
+            uint8_t* row = map.row(ny);
+            for (int nx = std::max(0, x - 1); nx <= std::min(map.width - 1, x + 1); nx++) {
+                if (row[nx] == 128) {
+                    row[nx] = 255;
+                    stack.emplace_back(nx, ny);
+                }
+            }
+        }
+    }
+    for (int y = 0; y < map.height; y++) {
+        uint8_t* row = map.row(y);
+        for (int x = 0; x < map.width; x++) row[x] = row[x] == 255 ? 255 : 0;
+    }
+}
+
+#endif // EDGE_DETECTION_H
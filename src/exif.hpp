@@ -0,0 +1,76 @@
+// exif.hpp
+#ifndef EXIF_H
+#define EXIF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// EXIF Orientation tag (1-8) of a JPEG, or 1 when the data has none. Only
+// the marker segments before the image data are scanned, so this costs
+// nothing next to decoding. Malformed metadata is treated as "no tag".
+inline int exifOrientation(const uint8_t* data, size_t size) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return 1; // Not a JPEG
+
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) return 1;
+        const uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) { pos++; continue; } // Fill byte
+        if (marker == 0xDA || marker == 0xD9) return 1; // Image data starts: no Exif before it
+
+        const size_t length = (data[pos + 2] << 8) | data[pos + 3];
+        const uint8_t* segment = data + pos + 4;
+        const size_t segmentSize = length >= 2 ? length - 2 : 0;
+        if (pos + 2 + length > size) return 1;
+
+        if (marker == 0xE1 && segmentSize >= 14 && std::memcmp(segment, "Exif\0\0", 6) == 0) {
+            // TIFF header: byte order, 42, offset of the first IFD
+            const uint8_t* tiff = segment + 6;
+            const size_t tiffSize = segmentSize - 6;
+            const bool little = tiff[0] == 'I' && tiff[1] == 'I';
+            if (!little && !(tiff[0] == 'M' && tiff[1] == 'M')) return 1;
+
+            auto read16 = [&](size_t at) -> uint32_t {
+                return little ? tiff[at] | (tiff[at + 1] << 8) : (tiff[at] << 8) | tiff[at + 1];
+            };
+            auto read32 = [&](size_t at) -> uint32_t {
+                return little ? read16(at) | (read16(at + 2) << 16) : (read16(at) << 16) | read16(at + 2);
+            };
+
+            const size_t ifd = read32(4);
+            if (ifd + 2 > tiffSize) return 1;
+            const uint32_t entries = read16(ifd);
+            for (uint32_t i = 0; i < entries; i++) {
+                const size_t entry = ifd + 2 + i * 12;
+                if (entry + 12 > tiffSize) return 1;
+                if (read16(entry) == 0x0112) { // Orientation, a SHORT stored inline
+                    const uint32_t value = read16(entry + 8);
+                    return value >= 1 && value <= 8 ? static_cast<int>(value) : 1;
+                }
+            }
+            return 1;
+        }
+        pos += 2 + length;
+    }
+    return 1;
+}
+
+inline int exifOrientation(const std::string& bytes) {
+    return exifOrientation(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+}
+
+// Orientation of a JPEG file; reads only its head, where Exif lives
+inline int exifOrientationOfFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return 1;
+    std::vector<uint8_t> head(128 << 10); // APP1 is at most 64 KiB, after at most an APP0
+    in.read(reinterpret_cast<char*>(head.data()), head.size());
+    return exifOrientation(head.data(), static_cast<size_t>(in.gcount()));
+}
+
+#endif // EXIF_H
@@ -0,0 +1,228 @@
+// gaussian_blur.hpp
+#ifndef GAUSSIAN_BLUR_H
+#define GAUSSIAN_BLUR_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "image_view.hpp"
+
+
+enum class BlurMode {
+    Auto,      // Separable for small kernels, box cascade for large ones
+    Separable, // Exact two-pass convolution, O(k) per sample
+    Box        // Three box passes approximating the Gaussian, O(1) per sample
+};
+
+// From this kernel size up, Auto switches to the constant-time box cascade
+constexpr int kBoxBlurMinKernel = 15;
+
+
+// Largest kernel size and sigma accepted from callers; the box cascade is
+// constant-time in the radius, but the separable path and the kernel table are not
+constexpr int kMaxBlurKernel = 1001;
+constexpr float kMaxBlurSigma = 500.0f;
+
+// Throws std::invalid_argument for a kernel size or sigma beyond the limits.
+// Takes the size as float so parsed values are checked before any int cast.
+inline void checkBlurArguments(float kernelSize, float sigma) {
+    if (!(kernelSize >= 0 && kernelSize <= kMaxBlurKernel)) {
+        throw std::invalid_argument("Blur kernel size must be in [0, " + std::to_string(kMaxBlurKernel) + "]");
+    }
+    if (!std::isfinite(sigma) || sigma > kMaxBlurSigma) {
+        throw std::invalid_argument("Blur sigma must be finite and at most " + std::to_string(int(kMaxBlurSigma)));
+    }
+}
+
+// Normalises blur arguments in place: odd kernel size, sigma derived from the
+// size when <= 0 (size / 6, i.e. +-3 sigma), Auto resolved to a concrete mode.
+// Returns false when the blur would leave the image unchanged.
+inline bool resolveBlur(int& kernelSize, float& sigma, BlurMode& mode) {
+    if (kernelSize < 2) return false;
+    if (sigma <= 0.0f) sigma = kernelSize / 6.0f;
+    if (kernelSize % 2 == 0) kernelSize++; // Taps span -size/2..size/2
+    if (mode == BlurMode::Auto) {
+        mode = kernelSize >= kBoxBlurMinKernel ? BlurMode::Box : BlurMode::Separable;
+    }
+    return true;
+}
+
+
+// Normalised 1D Gaussian kernels, shared between calls and threads.
+class GaussianKernelCache {
+public:
+    using Kernel = std::shared_ptr<const std::vector<float>>;
+
+    static Kernel get(int size, float sigma) {
+        static std::mutex mutex;
+        static std::map<std::pair<int, float>, Kernel> cache;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cache.size() >= kMaxEntries) cache.clear(); // sigmas come from requests, keep it bounded
+        Kernel& kernel = cache[{size, sigma}];
+        if (!kernel) kernel = std::make_shared<const std::vector<float>>(build(size, sigma));
+        return kernel;
+    }
+
+private:
+    static constexpr size_t kMaxEntries = 64;
+
+    static std::vector<float> build(int size, float sigma) {
+        std::vector<float> kernel(size);
+        float sum = 0.0f;
+
+        for (int i = 0; i < size; i++) {
+            int d = i - size / 2;
+            kernel[i] = std::exp(-(d * d) / (2 * sigma * sigma));
+            sum += kernel[i];
+        }
+        for (float& weight : kernel) weight /= sum;
+        return kernel;
+    }
+};
+
+
+// Horizontal pass of one row into `out`. The row is first copied into `padded`
+// with its edge pixels replicated, so the convolution itself never clamps.
+inline void blurRowHorizontal(const uint8_t* in, float* out, float* padded,
+                              int width, int channels, const std::vector<float>& kernel) {
+    const int radius = static_cast<int>(kernel.size()) / 2;
+    const size_t rowLen = static_cast<size_t>(width) * channels;
+
+    for (int x = -radius; x < width + radius; x++) {
+        const uint8_t* src = in + static_cast<size_t>(std::clamp(x, 0, width - 1)) * channels;
+        float* dst = padded + static_cast<size_t>(x + radius) * channels;
+        for (int c = 0; c < channels; c++) dst[c] = src[c];
+    }
+
+    std::fill(out, out + rowLen, 0.0f);
+    for (size_t k = 0; k < kernel.size(); k++) {
+        const float weight = kernel[k];
+        const float* tap = padded + k * channels;
+        for (size_t i = 0; i < rowLen; i++) out[i] += weight * tap[i];
+    }
+}
+
+// Separable Gaussian for output rows [y0, y1). Horizontally filtered rows are
+// kept in a ring of kernel.size() lines so each source row is filtered once.
+inline void gaussianBlurSeparable(ConstImageView src, ImageView dst,
+                                  const std::vector<float>& kernel, int y0, int y1) {
+    const int size = static_cast<int>(kernel.size());
+    const int radius = size / 2;
+    const size_t rowLen = src.rowBytes();
+
+    std::vector<float> ring(static_cast<size_t>(size) * rowLen);
+    std::vector<float> padded(static_cast<size_t>(src.width + 2 * radius) * src.channels);
+    std::vector<float> acc(rowLen);
+
+    const int first = y0 - radius; // virtual row held by ring slot 0
+    int filled = first;            // next virtual row to filter
+    auto slot = [&](int v) { return ring.data() + static_cast<size_t>((v - first) % size) * rowLen; };
+
+    for (int y = y0; y < y1; y++) {
+        for (; filled <= y + radius; filled++) {
+            const uint8_t* in = src.row(std::clamp(filled, 0, src.height - 1));
+            blurRowHorizontal(in, slot(filled), padded.data(), src.width, src.channels, kernel);
+        }
+
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (int k = 0; k < size; k++) {
+            const float weight = kernel[k];
+            const float* line = slot(y - radius + k);
+            for (size_t i = 0; i < rowLen; i++) acc[i] += weight * line[i];
+        }
+
+        uint8_t* out = dst.row(y);
+        for (size_t i = 0; i < rowLen; i++) {
+            out[i] = static_cast<uint8_t>(std::min(acc[i], 255.0f));
+        }
+    }
+}
+
+
+// Box widths whose three-fold cascade has the variance of a Gaussian with
+// the given sigma (Kovesi, "Fast almost-Gaussian filtering").
+// Worked in double, so large sigmas cannot overflow the products.
+inline std::vector<int> boxesForGauss(float sigma, int passes = 3) {
+    const double s2 = static_cast<double>(sigma) * sigma;
+    const double wIdeal = std::sqrt(12 * s2 / passes + 1);
+    int wl = static_cast<int>(std::floor(wIdeal));
+    if (wl % 2 == 0) wl--;
+    int wu = wl + 2;
+
+    const double w = wl;
+    const double mIdeal = (12 * s2 - passes * w * w - 4 * passes * w - 3 * passes) / (-4 * w - 4);
+    int m = static_cast<int>(std::round(mIdeal));
+
+    std::vector<int> sizes;
+    for (int i = 0; i < passes; i++) sizes.push_back(i < m ? wl : wu);
+    return sizes;
+}
+
+// Box radius actually used along a side of `length` pixels. Beyond the side
+// the window is almost all replicated edge, so larger radii change next to
+// nothing and would only make the padding (and the cost) grow.
+inline int boxRadiusFor(int radius, int length) { return std::min(radius, std::max(length, 1)); }
+
+// Running-sum box filter along one interleaved row, in place. `line` must
+// hold width + 2 * boxRadiusFor(radius, width) pixels.
+inline void boxBlurRow(uint8_t* row, uint8_t* line, int width, int channels, int radius) {
+    radius = boxRadiusFor(radius, width);
+    const int window = 2 * radius + 1;
+    const uint64_t scale = (uint64_t(1) << 32) / window + 1;
+    const size_t step = channels;
+
+    for (int x = -radius; x < width + radius; x++) {
+        const uint8_t* src = row + static_cast<size_t>(std::clamp(x, 0, width - 1)) * step;
+        std::copy(src, src + channels, line + static_cast<size_t>(x + radius) * step);
+    }
+
+    for (int c = 0; c < channels; c++) {
+        uint64_t sum = 0;
+        for (int k = 0; k < window; k++) sum += line[k * step + c];
+
+        for (int x = 0; x < width; x++) {
+            row[x * step + c] = static_cast<uint8_t>(((sum + window / 2) * scale) >> 32);
+            if (x + 1 == width) break;
+            sum += line[(x + window) * step + c];
+            sum -= line[x * step + c];
+        }
+    }
+}
+
+// Running-sum box filter down columns [x0, x1) of the row, from src to dst.
+inline void boxBlurColumns(ConstImageView src, ImageView dst, int radius, int x0, int x1) {
+    radius = boxRadiusFor(radius, src.height);
+    const int window = 2 * radius + 1;
+    const uint64_t scale = (uint64_t(1) << 32) / window + 1;
+    const size_t begin = static_cast<size_t>(x0) * src.channels;
+    const size_t end = static_cast<size_t>(x1) * src.channels;
+
+    // At most 2 * height + 1 rows of 255, so 32 bits hold it below 8M rows
+    std::vector<uint32_t> sum(end - begin, 0);
+    for (int k = -radius; k <= radius; k++) {
+        const uint8_t* in = src.row(std::clamp(k, 0, src.height - 1));
+        for (size_t i = begin; i < end; i++) sum[i - begin] += in[i];
+    }
+
+    for (int y = 0; y < src.height; y++) {
+        uint8_t* out = dst.row(y);
+        const uint8_t* add = src.row(std::min(y + radius + 1, src.height - 1));
+        const uint8_t* sub = src.row(std::max(y - radius, 0));
+        for (size_t i = begin; i < end; i++) {
+            uint32_t& s = sum[i - begin];
+            out[i] = static_cast<uint8_t>(((s + window / 2) * scale) >> 32);
+            s += add[i];
+            s -= sub[i];
+        }
+    }
+}
+
+#endif // GAUSSIAN_BLUR_H
@@ -0,0 +1,68 @@
+// geometry.hpp
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "image_view.hpp"
+
+
+// Kernels for the quarter-turn transforms. Every one of them is a transpose
+// that may read the source columns and/or rows backwards:
+//   transpose            dst(x, y) = src(y, x)
+//   rotate 90 clockwise  reverseRows
+//   rotate 270 clockwise reverseColumns
+//   transverse           both
+// dst is src.height pixels wide and src.width pixels tall.
+
+// Output tiles are this many pixels wide, so the source rows one tile reads
+// (one cache line each) stay in L1 while the tile's output rows are written
+template <int Channels>
+inline void transposeRowsFor(ConstImageView src, ImageView dst, bool reverseColumns, bool reverseRows,
+                             int y0, int y1) {
+    constexpr int kTile = 64;
+    const int channels = Channels > 0 ? Channels : src.channels;
+    for (int tx = 0; tx < dst.width; tx += kTile) {
+        const int tx1 = std::min(tx + kTile, dst.width);
+        for (int y = y0; y < y1; y++) {
+            const size_t sx = static_cast<size_t>(reverseColumns ? src.width - 1 - y : y) * channels;
+            uint8_t* out = dst.pixel(y, tx);
+            for (int x = tx; x < tx1; x++, out += channels) {
+                const int sy = reverseRows ? src.height - 1 - x : x;
+                // A fixed-size copy compiles to a plain load and store
+                std::memcpy(out, src.row(sy) + sx, Channels > 0 ? Channels : channels);
+            }
+        }
+    }
+}
+
+// Rows [y0, y1) of dst
+inline void transposeRows(ConstImageView src, ImageView dst, bool reverseColumns, bool reverseRows,
+                          int y0, int y1) {
+    switch (src.channels) {
+        case 1: transposeRowsFor<1>(src, dst, reverseColumns, reverseRows, y0, y1); break;
+        case 3: transposeRowsFor<3>(src, dst, reverseColumns, reverseRows, y0, y1); break;
+        case 4: transposeRowsFor<4>(src, dst, reverseColumns, reverseRows, y0, y1); break;
+        default: transposeRowsFor<0>(src, dst, reverseColumns, reverseRows, y0, y1); break;
+    }
+}
+
+// Rotates by 180 degrees in place: each row in [y0, y1) of the top half
+// swaps, reversed, with its mirror row; the middle row of an odd height
+// is reversed on its own
+inline void rotate180Rows(ImageView image, int y0, int y1) {
+    const int channels = image.channels;
+    for (int y = y0; y < y1; y++) {
+        const int mirror = image.height - 1 - y;
+        uint8_t* a = image.row(y);
+        uint8_t* b = image.row(mirror) + static_cast<size_t>(image.width - 1) * channels;
+        const int count = y == mirror ? image.width / 2 : image.width;
+        for (int x = 0; x < count; x++, a += channels, b -= channels) {
+            std::swap_ranges(a, a + channels, b);
+        }
+    }
+}
+
+#endif // GEOMETRY_H
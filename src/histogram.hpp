@@ -0,0 +1,222 @@
+// histogram.hpp
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+#include "image_view.hpp"
+#include "point_ops.hpp"
+#include "resample.hpp"
+
+
+// Counts of each 8-bit value in one channel, and the statistics read off them
+struct ChannelHistogram {
+    std::array<uint64_t, 256> bins{};
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (uint64_t n : bins) total += n;
+        return total;
+    }
+
+    // Smallest and largest value present; 0 and 0 when empty
+    int min() const {
+        for (int v = 0; v < 256; v++) {
+            if (bins[v]) return v;
+        }
+        return 0;
+    }
+
+    int max() const {
+        for (int v = 255; v >= 0; v--) {
+            if (bins[v]) return v;
+        }
+        return 0;
+    }
+
+    double mean() const {
+        uint64_t total = 0, sum = 0;
+        for (int v = 0; v < 256; v++) {
+            total += bins[v];
+            sum += bins[v] * v;
+        }
+        return total ? static_cast<double>(sum) / total : 0.0;
+    }
+
+    double standardDeviation() const {
+        const double m = mean();
+        const uint64_t total = count();
+        double sum = 0;
+        for (int v = 0; v < 256; v++) sum += bins[v] * (v - m) * (v - m);
+        return total ? std::sqrt(sum / total) : 0.0;
+    }
+
+    // Smallest value with at least `fraction` (0..1) of the samples at or below it
+    int percentile(double fraction) const {
+        const uint64_t total = count();
+        if (total == 0) return 0;
+        const double target = std::clamp(fraction, 0.0, 1.0) * total;
+        uint64_t below = 0;
+        for (int v = 0; v < 256; v++) {
+            below += bins[v];
+            if (below >= target && below > 0) return v;
+        }
+        return 255;
+    }
+
+    ChannelHistogram& operator+=(const ChannelHistogram& other) {
+        for (int v = 0; v < 256; v++) bins[v] += other.bins[v];
+        return *this;
+    }
+};
+
+
+// Counts `pixels` pixels of p into two alternating sets of 32-bit bins per
+// channel (`bins` holds 2 x 256 per channel), so runs of equal values do not
+// wait on the same counter
+template <int Channels>
+inline void countPixels(const uint8_t* p, int pixels, int channelCount, uint32_t* bins) {
+    const int channels = Channels > 0 ? Channels : channelCount;
+    int x = 0;
+    for (; x + 2 <= pixels; x += 2, p += 2 * channels) {
+        for (int c = 0; c < channels; c++) {
+            uint32_t* set = bins + 2 * 256 * c;
+            set[p[c]]++;
+            set[256 + p[channels + c]]++;
+        }
+    }
+    if (x < pixels) {
+        for (int c = 0; c < channels; c++) bins[2 * 256 * c + p[c]]++;
+    }
+}
+
+// Adds the pixels of rows [y0, y1), columns [x0, x1) to one histogram per
+// channel. The 32-bit counts are folded into `histograms` well before they
+// could overflow.
+inline void histogramRows(ConstImageView src, ChannelHistogram* histograms, int x0, int x1, int y0, int y1) {
+    const int channels = src.channels;
+    const int pixels = x1 - x0;
+    if (pixels <= 0) return;
+    std::vector<uint32_t> bins(2 * 256 * static_cast<size_t>(channels), 0);
+    const int flushRows = std::max(1, (1 << 30) / (pixels * channels));
+
+    auto flush = [&]() {
+        for (int c = 0; c < channels; c++) {
+            const uint32_t* set = bins.data() + 2 * 256 * c;
+            for (int v = 0; v < 256; v++) histograms[c].bins[v] += set[v] + set[256 + v];
+        }
+        std::fill(bins.begin(), bins.end(), 0);
+    };
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* p = src.row(y) + static_cast<size_t>(x0) * channels;
+        switch (channels) {
+            case 1: countPixels<1>(p, pixels, 1, bins.data()); break;
+            case 3: countPixels<3>(p, pixels, 3, bins.data()); break;
+            case 4: countPixels<4>(p, pixels, 4, bins.data()); break;
+            default: countPixels<0>(p, pixels, channels, bins.data()); break;
+        }
+        if ((y - y0 + 1) % flushRows == 0) flush();
+    }
+    flush();
+}
+
+
+// Lookup tables for the automatic corrections. Each maps one channel (or
+// the channels the histogram was pooled from) and is applied with PointOp.
+
+// Linear stretch of [low, high] to [0, 255]; the identity when high <= low
+inline PointOp::Table levelsTable(int low, int high) {
+    PointOp::Table table;
+    for (int v = 0; v < 256; v++) {
+        if (high <= low) {
+            table[v] = static_cast<uint8_t>(v);
+            continue;
+        }
+        const int stretched = ((v - low) * 255 * 2 + (high - low)) / (2 * (high - low));
+        table[v] = static_cast<uint8_t>(std::clamp(v <= low ? 0 : stretched, 0, 255));
+    }
+    return table;
+}
+
+// Maps each value to its rank, so the output histogram is as flat as 8 bits
+// allow. The darkest value present maps to 0 and the brightest to 255.
+inline PointOp::Table equalizationTable(const ChannelHistogram& histogram) {
+    PointOp::Table table;
+    const uint64_t total = histogram.count();
+    const uint64_t first = histogram.bins[histogram.min()];
+    uint64_t below = 0;
+    for (int v = 0; v < 256; v++) {
+        below += histogram.bins[v];
+        table[v] = total > first
+                       ? static_cast<uint8_t>(below <= first ? 0 : ((below - first) * 255 * 2 + (total - first)) /
+                                                                       (2 * (total - first)))
+                       : static_cast<uint8_t>(v);
+    }
+    return table;
+}
+
+// Equalization of a region with each bin first capped at `clipLimit` times
+// the mean bin count; the excess is spread over all bins. This bounds the
+// slope of the mapping, so flat regions do not turn into noise (CLAHE).
+inline PointOp::Table claheTable(const ChannelHistogram& histogram, float clipLimit) {
+    const uint64_t total = histogram.count();
+    PointOp::Table table;
+    if (total == 0) {
+        for (int v = 0; v < 256; v++) table[v] = static_cast<uint8_t>(v);
+        return table;
+    }
+    const uint64_t limit = std::max<uint64_t>(1, static_cast<uint64_t>(clipLimit * total / 256.0));
+    std::array<uint64_t, 256> bins;
+    uint64_t excess = 0;
+    for (int v = 0; v < 256; v++) {
+        bins[v] = std::min(histogram.bins[v], limit);
+        excess += histogram.bins[v] - bins[v];
+    }
+    // Spread evenly, the remainder one per bin across the whole range
+    const uint64_t share = excess / 256, rest = excess % 256;
+    const int step = rest ? static_cast<int>(256 / rest) : 0;
+    for (int v = 0; v < 256; v++) {
+        bins[v] += share + (rest && v % step == 0 && static_cast<uint64_t>(v / step) < rest ? 1 : 0);
+    }
+    uint64_t below = 0;
+    for (int v = 0; v < 256; v++) {
+        below += bins[v];
+        table[v] = static_cast<uint8_t>(std::min<uint64_t>(255, (below * 255 * 2 + total) / (2 * total)));
+    }
+    return table;
+}
+
+
+// CLAHE's per-tile tables applied to rows [y0, y1) of the first `colourChannels`
+// channels: each pixel blends the tables of the four nearest tile centres.
+// `tables` holds tilesY rows of tilesX tables; xs and ys are BilinearTaps
+// from the tile grid to the image size.
+inline void claheRows(ImageView image, int colourChannels, const std::vector<PointOp::Table>& tables,
+                      int tilesX, const BilinearTaps& xs, const BilinearTaps& ys, int y0, int y1) {
+    const int channels = image.channels;
+    const int tilesY = static_cast<int>(tables.size()) / tilesX;
+    for (int y = y0; y < y1; y++) {
+        const PointOp::Table* top = tables.data() + static_cast<size_t>(ys.index[y]) * tilesX;
+        const PointOp::Table* bottom = tables.data() + static_cast<size_t>(std::min(ys.index[y] + 1, tilesY - 1)) * tilesX;
+        const int wy = ys.weight[y];
+        uint8_t* p = image.row(y);
+        for (int x = 0; x < image.width; x++, p += channels) {
+            const int left = xs.index[x];
+            const int right = std::min(left + 1, tilesX - 1);
+            const int wx = xs.weight[x];
+            for (int c = 0; c < colourChannels; c++) {
+                const uint8_t v = p[c];
+                const int upper = top[left][v] * (256 - wx) + top[right][v] * wx;
+                const int lower = bottom[left][v] * (256 - wx) + bottom[right][v] * wx;
+                p[c] = static_cast<uint8_t>((upper * (256 - wy) + lower * wy + (1 << 15)) >> 16);
+            }
+        }
+    }
+}
+
+#endif // HISTOGRAM_H
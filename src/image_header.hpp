@@ -0,0 +1,196 @@
+// image_header.hpp
+#ifndef IMAGE_HEADER_H
+#define IMAGE_HEADER_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+
+// Format and dimensions of an encoded image, read from its first bytes
+// without decoding anything. Lets an upload be turned away before a single
+// pixel is allocated, however small the compressed data is.
+struct ImageHeader {
+    std::string format; // "jpeg", "png", "webp", "gif", "bmp", "tiff", "pnm"; empty when unrecognised
+    int width = 0;
+    int height = 0;
+
+    bool known() const { return !format.empty() && width > 0 && height > 0; }
+};
+
+// Thrown when an image is larger than the decode limits allow
+struct ImageTooLarge : std::invalid_argument {
+    using std::invalid_argument::invalid_argument;
+};
+
+// Caps checked against the header before decoding. IMAGE_MAX_PIXELS
+// (default 100 million) and IMAGE_MAX_DIMENSION (default 32768) override them.
+struct DecodeLimits {
+    uint64_t maxPixels = 100000000;
+    int maxDimension = 32768;
+
+    static DecodeLimits fromEnvironment() {
+        DecodeLimits limits;
+        if (const char* pixels = std::getenv("IMAGE_MAX_PIXELS")) {
+            limits.maxPixels = std::strtoull(pixels, nullptr, 10);
+        }
+        if (const char* dimension = std::getenv("IMAGE_MAX_DIMENSION")) {
+            limits.maxDimension = std::atoi(dimension);
+        }
+        return limits;
+    }
+
+    // Throws ImageTooLarge when `header` exceeds the limits
+    void check(const ImageHeader& header) const {
+        if (header.width > maxDimension || header.height > maxDimension ||
+            static_cast<uint64_t>(header.width) * static_cast<uint64_t>(header.height) > maxPixels) {
+            throw ImageTooLarge("Image of " + std::to_string(header.width) + "x" + std::to_string(header.height) +
+                                " pixels exceeds the limit of " + std::to_string(maxPixels) + " pixels or " +
+                                std::to_string(maxDimension) + " per side");
+        }
+    }
+};
+
+
+namespace image_header_detail {
+
+inline uint32_t be16(const uint8_t* p) { return (p[0] << 8) | p[1]; }
+inline uint32_t le16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+inline uint32_t be32(const uint8_t* p) { return (be16(p) << 16) | be16(p + 2); }
+inline uint32_t le32(const uint8_t* p) { return le16(p) | (le16(p + 2) << 16); }
+
+inline ImageHeader sized(const char* format, int64_t width, int64_t height) {
+    ImageHeader header;
+    header.format = format;
+    // Anything beyond int is over any limit anyway
+    header.width = static_cast<int>(std::min<int64_t>(width < 0 ? -width : width, INT32_MAX));
+    header.height = static_cast<int>(std::min<int64_t>(height < 0 ? -height : height, INT32_MAX));
+    return header;
+}
+
+// Frame header (SOFn) of a JPEG: the first one ends the marker segments we need
+inline ImageHeader jpeg(const uint8_t* data, size_t size) {
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) break;
+        const uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) { pos++; continue; }
+        if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7)) { pos += 2; continue; } // No length
+        if (marker == 0xDA || marker == 0xD9) break; // Scan data before any frame header
+        const size_t length = be16(data + pos + 2);
+        const bool frame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (frame && pos + 9 <= size) return sized("jpeg", be16(data + pos + 7), be16(data + pos + 5));
+        pos += 2 + length;
+    }
+    return sized("jpeg", 0, 0);
+}
+
+// First image file directory: ImageWidth (0x100) and ImageLength (0x101)
+inline ImageHeader tiff(const uint8_t* data, size_t size) {
+    const bool little = data[0] == 'I';
+    auto read16 = [&](size_t at) { return little ? le16(data + at) : be16(data + at); };
+    auto read32 = [&](size_t at) { return little ? le32(data + at) : be32(data + at); };
+    int64_t width = 0, height = 0;
+    const size_t ifd = read32(4);
+    if (ifd + 2 <= size) {
+        const uint32_t entries = read16(ifd);
+        for (uint32_t i = 0; i < entries && ifd + 2 + (i + 1) * 12 <= size; i++) {
+            const size_t entry = ifd + 2 + i * 12;
+            const uint32_t tag = read16(entry);
+            if (tag != 0x100 && tag != 0x101) continue;
+            const uint32_t value = read16(entry + 2) == 3 ? read16(entry + 8) : read32(entry + 8); // SHORT or LONG
+            (tag == 0x100 ? width : height) = value;
+        }
+    }
+    return sized("tiff", width, height);
+}
+
+// Decimal digits at `pos`, saturating at INT32_MAX
+inline int64_t number(const uint8_t* data, size_t size, size_t& pos) {
+    int64_t value = 0;
+    while (pos < size && std::isdigit(data[pos]) && value < INT32_MAX) value = value * 10 + (data[pos++] - '0');
+    return value;
+}
+
+// P1-P6 text header: magic, width, height, with # comments between
+inline ImageHeader pnm(const uint8_t* data, size_t size) {
+    size_t pos = 2;
+    int64_t values[2] = {0, 0};
+    for (int64_t& value : values) {
+        while (pos < size && (std::isspace(data[pos]) || data[pos] == '#')) {
+            if (data[pos] == '#') {
+                while (pos < size && data[pos] != '\n') pos++;
+            } else {
+                pos++;
+            }
+        }
+        value = number(data, size, pos);
+    }
+    return sized("pnm", values[0], values[1]);
+}
+
+// P7 (PAM) header: "KEYWORD value" lines up to ENDHDR, WIDTH and HEIGHT among them
+inline ImageHeader pam(const uint8_t* data, size_t size) {
+    int64_t width = 0, height = 0;
+    size_t pos = 3;
+    while (pos < size) {
+        const size_t end = std::find(data + pos, data + size, '\n') - data;
+        while (pos < end && std::isspace(data[pos])) pos++;
+        const size_t keyStart = pos;
+        while (pos < end && !std::isspace(data[pos])) pos++;
+        const std::string keyword(data + keyStart, data + pos);
+        if (keyword == "ENDHDR") break;
+        while (pos < end && std::isspace(data[pos])) pos++;
+        if (keyword == "WIDTH") width = number(data, end, pos);
+        if (keyword == "HEIGHT") height = number(data, end, pos);
+        pos = end + 1;
+    }
+    return sized("pnm", width, height);
+}
+
+} // namespace image_header_detail
+
+inline ImageHeader inspectImageHeader(const uint8_t* data, size_t size) {
+    using namespace image_header_detail;
+    if (size >= 4 && data[0] == 0xFF && data[1] == 0xD8) return jpeg(data, size);
+    if (size >= 24 && std::memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0 && std::memcmp(data + 12, "IHDR", 4) == 0) {
+        return sized("png", be32(data + 16), be32(data + 20));
+    }
+    if (size >= 25 && std::memcmp(data, "RIFF", 4) == 0 && std::memcmp(data + 8, "WEBP", 4) == 0) {
+        const uint8_t* chunk = data + 12;
+        if (std::memcmp(chunk, "VP8L", 4) == 0) {
+            const uint32_t bits = le32(data + 21);
+            return sized("webp", (bits & 0x3FFF) + 1, ((bits >> 14) & 0x3FFF) + 1);
+        }
+        if (size < 30) return sized("webp", 0, 0);
+        if (std::memcmp(chunk, "VP8 ", 4) == 0) return sized("webp", le16(data + 26) & 0x3FFF, le16(data + 28) & 0x3FFF);
+        if (std::memcmp(chunk, "VP8X", 4) == 0 && size >= 31) { // Height ends at byte 30
+            return sized("webp", (le32(data + 24) & 0xFFFFFF) + 1, (le32(data + 27) & 0xFFFFFF) + 1);
+        }
+        return sized("webp", 0, 0);
+    }
+    if (size >= 10 && (std::memcmp(data, "GIF87a", 6) == 0 || std::memcmp(data, "GIF89a", 6) == 0)) {
+        return sized("gif", le16(data + 6), le16(data + 8));
+    }
+    if (size >= 26 && data[0] == 'B' && data[1] == 'M') {
+        return sized("bmp", static_cast<int32_t>(le32(data + 18)), static_cast<int32_t>(le32(data + 22)));
+    }
+    if (size >= 8 && (std::memcmp(data, "II*\0", 4) == 0 || std::memcmp(data, "MM\0*", 4) == 0)) {
+        return tiff(data, size);
+    }
+    if (size >= 3 && data[0] == 'P' && data[1] >= '1' && data[1] <= '7' && std::isspace(data[2])) {
+        return data[1] == '7' ? pam(data, size) : pnm(data, size);
+    }
+    return ImageHeader();
+}
+
+inline ImageHeader inspectImageHeader(const std::string& bytes) {
+    return inspectImageHeader(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+}
+
+#endif // IMAGE_HEADER_H
@@ -6,22 +6,117 @@
 #include <cmath>
 #include <algorithm>
 #include <stdexcept>
+#include <utility>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "image_view.hpp"
+#include "buffer_pool.hpp"
+#include "pixel_format.hpp"
+#include "gaussian_blur.hpp"
+#include "thread_pool.hpp"
+#include "simd_point_ops.hpp"
+#include "point_ops.hpp"
+#include "row_kernels.hpp"
+#include "color_matrix.hpp"
+#include "edge_detection.hpp"
+#include "resample.hpp"
+#include "geometry.hpp"
+#include "histogram.hpp"
 
 
 class Image {
 private:
-    std::vector<std::vector<std::vector<uint8_t>>> data; // Height x Width x Channels
+    // Height rows of `stride` bytes, channels interleaved in the order
+    // `format` gives. Shared so that an image can also sit on memory owned by
+    // someone else (see wrap()).
+    std::shared_ptr<uint8_t> buffer;
+    size_t stride;
     int width;
     int height;
     int channels;
+    PixelFormat format;
 
 
 public:
-    // Constructor
-    Image(int width, int height, int channels = 3) 
-        : width(width), height(height), channels(channels) {
-        data.resize(height, std::vector<std::vector<uint8_t>>(
-            width, std::vector<uint8_t>(channels, 0)));
+    // Constructor; 1-4 channels are taken as gray, gray + alpha, BGR and BGRA
+    Image(int width, int height, int channels = 3)
+        : Image(width, height, channels, true) {}
+
+    Image(int width, int height, PixelFormat format)
+        : Image(width, height, format, true) {}
+
+    // Image whose pixels are left uninitialised, for callers that are about
+    // to overwrite all of them
+    static Image uninitialized(int width, int height, int channels) {
+        return Image(width, height, channels, false);
+    }
+
+    static Image uninitialized(int width, int height, PixelFormat format) {
+        return Image(width, height, format, false);
+    }
+
+    // Image over `height` rows of external pixels, `stride` bytes apart, without
+    // copying them. `owner` is kept alive for as long as the image uses the
+    // memory; pass an empty owner when the caller guarantees the lifetime.
+    // Operations that need a second buffer (blur, Sobel, grayscale) move the
+    // image onto its own storage, so read results back through the image.
+    static Image wrap(uint8_t* pixels, int width, int height, int channels, size_t stride,
+                      std::shared_ptr<void> owner = nullptr) {
+        return wrap(pixels, width, height, defaultPixelFormat(channels), stride, std::move(owner));
+    }
+
+    static Image wrap(uint8_t* pixels, int width, int height, PixelFormat format, size_t stride,
+                      std::shared_ptr<void> owner = nullptr) {
+        const int channels = pixelFormatChannels(format);
+        if (width < 0 || height < 0 ||
+            stride < static_cast<size_t>(width) * channels || (!pixels && width * height > 0)) {
+            throw std::invalid_argument("Invalid external image buffer");
+        }
+        Image image;
+        image.buffer = std::shared_ptr<uint8_t>(std::move(owner), pixels);
+        image.stride = stride;
+        image.width = width;
+        image.height = height;
+        image.channels = channels;
+        image.format = format;
+        return image;
+    }
+
+    Image(const Image& other)
+        : Image(other.width, other.height, other.format, false) {
+        copyPixels(other.view(), view());
+    }
+
+    Image& operator=(const Image& other) {
+        if (this != &other) {
+            Image copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    Image(Image&& other) noexcept
+        : buffer(std::move(other.buffer)), stride(other.stride),
+          width(other.width), height(other.height), channels(other.channels), format(other.format) {
+        other.stride = 0;
+        other.width = other.height = 0;
+    }
+
+    Image& operator=(Image&& other) noexcept {
+        Image moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    void swap(Image& other) noexcept {
+        std::swap(buffer, other.buffer);
+        std::swap(stride, other.stride);
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(channels, other.channels);
+        std::swap(format, other.format);
     }
 
 
@@ -29,279 +124,427 @@ public:
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     int getChannels() const { return channels; }
+    size_t getStride() const { return stride; }
+    PixelFormat getPixelFormat() const { return format; }
+
+    // Relabels the channels without touching the pixels, e.g. RGB8 for
+    // pixels read from a PPM file. The channel count must stay the same.
+    void setPixelFormat(PixelFormat newFormat) {
+        if (pixelFormatChannels(newFormat) != channels) {
+            throw std::invalid_argument(std::string("Pixel format ") + pixelFormatName(newFormat) +
+                                        " does not have " + std::to_string(channels) + " channels");
+        }
+        format = newFormat;
+    }
+
+    // Raw row access, for handing rows to OpenCV or vector code
+    uint8_t* row(int y) { return buffer.get() + static_cast<size_t>(y) * stride; }
+    const uint8_t* row(int y) const { return buffer.get() + static_cast<size_t>(y) * stride; }
+
+    ImageView view() { return ImageView(buffer.get(), width, height, channels, stride, format); }
+    ConstImageView view() const { return ConstImageView(buffer.get(), width, height, channels, stride, format); }
 
     // Pixel access
     uint8_t& at(int y, int x, int channel) {
         if (x < 0 || x >= width || y < 0 || y >= height || channel < 0 || channel >= channels) {
             throw std::out_of_range("Index out of bounds");
         }
-        return data[y][x][channel];
+        return row(y)[static_cast<size_t>(x) * channels + channel];
     }
 
 
     // Basic Operations
+    // The per-byte point operations run on the SIMD kernels picked for this
+    // CPU (see simd_point_ops.hpp); the results match the scalar loops exactly.
+    // They run over whole rows, and forEachSpan() puts alpha back afterwards.
     void brightnessAdjust(int delta) {
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                for (int c = 0; c < channels; c++) {
-                    int newVal = std::clamp(static_cast<int>(data[y][x][c]) + delta, 0, 255);
-                    data[y][x][c] = static_cast<uint8_t>(newVal);
-                }
-            }
-        }
+        const PointKernels& kernels = pointKernels();
+        forEachSpan([&](uint8_t* p, size_t n) { kernels.brightness(p, n, delta); });
     }
 
     void contrastAdjust(float factor) {
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                for (int c = 0; c < channels; c++) {
-                    float pixel = data[y][x][c];
-                    float adjusted = 128 + (pixel - 128) * factor;
-                    data[y][x][c] = static_cast<uint8_t>(std::clamp(adjusted, 0.0f, 255.0f));
-                }
-            }
-        }
+        const PointKernels& kernels = pointKernels();
+        forEachSpan([&](uint8_t* p, size_t n) { kernels.contrast(p, n, factor); });
     }
 
     void invert() {
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                for (int c = 0; c < channels; c++) {
-                    data[y][x][c] = 255 - data[y][x][c];
-                }
-            }
+        const PointKernels& kernels = pointKernels();
+        forEachSpan([&](uint8_t* p, size_t n) { kernels.invert(p, n); });
+    }
+
+    // Applies a fused chain of point operations in one pass over the pixels;
+    // alpha is left as it is
+    void applyLUT(const PointOp& op) {
+        if (op.isIdentity()) return;
+
+        if (!op.isPerChannel()) {
+            forEachSpan([&](uint8_t* p, size_t n) { op.applyUniform(p, n); });
+            return;
         }
+        forEachBand([&](int y0, int y1) {
+            withPixelLayout(format, [&](auto layout) {
+                for (int y = y0; y < y1; y++) op.applyPixels<decltype(layout)>(row(y), width);
+            });
+        });
     }
 
     void adjustSaturation(float factor) {
-        if (channels < 3) return;
+        applyColorMatrix(ColorMatrix::saturation(factor));
+    }
 
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                float r = data[y][x][0];
-                float g = data[y][x][1];
-                float b = data[y][x][2];
-
-                float gray = 0.299f * r + 0.587f * g + 0.114f * b;
-                
-                r = gray + (r - gray) * factor;
-                g = gray + (g - gray) * factor;
-                b = gray + (b - gray) * factor;
-
-                data[y][x][0] = std::clamp(static_cast<int>(r), 0, 255);
-                data[y][x][1] = std::clamp(static_cast<int>(g), 0, 255);
-                data[y][x][2] = std::clamp(static_cast<int>(b), 0, 255);
-            }
-        }
+    void hueRotate(float degrees) {
+        applyColorMatrix(ColorMatrix::hueRotate(degrees));
     }
 
+    // Applies a (composed) colour matrix to red, green and blue in one pass;
+    // gray images are left alone
+    void applyColorMatrix(const ColorMatrix& matrix) {
+        if (channels < 3) return;
+
+        forEachBand([&](int y0, int y1) {
+            withPixelLayout(format, [&](auto layout) {
+                for (int y = y0; y < y1; y++) matrix.applyRow<decltype(layout)>(row(y), width);
+            });
+        });
+    }
 
     // Filters and Transformations
-    void applyGaussianBlur(int kernelSize = 3) {
-        std::vector<std::vector<std::vector<uint8_t>>> temp = data;
-        std::vector<std::vector<float>> kernel = createGaussianKernel(kernelSize);
-        
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                for (int c = 0; c < channels; c++) {
-                    float sum = 0.0f;
-                    float weightSum = 0.0f;
-                    
-                    for (int ky = -kernelSize/2; ky <= kernelSize/2; ky++) {
-                        for (int kx = -kernelSize/2; kx <= kernelSize/2; kx++) {
-                            int ny = std::clamp(y + ky, 0, height - 1);
-                            int nx = std::clamp(x + kx, 0, width - 1);
-                            float weight = kernel[ky + kernelSize/2][kx + kernelSize/2];
-                            
-                            sum += data[ny][nx][c] * weight;
-                            weightSum += weight;
-                        }
-                    }
-                    temp[y][x][c] = static_cast<uint8_t>(sum / weightSum);
-                }
+    // sigma <= 0 derives it from the kernel size (size / 6, i.e. +-3 sigma)
+    void applyGaussianBlur(int kernelSize = 3, float sigma = 0.0f, BlurMode mode = BlurMode::Auto) {
+        if (width == 0 || height == 0 || !resolveBlur(kernelSize, sigma, mode)) return;
+
+        Image temp(width, height, format, false);
+
+        if (mode == BlurMode::Separable) {
+            GaussianKernelCache::Kernel kernel = GaussianKernelCache::get(kernelSize, sigma);
+            // Each band re-filters its kernelSize - 1 halo rows, so keep bands
+            // several kernels tall
+            forEachBand([&](int y0, int y1) {
+                gaussianBlurSeparable(view(), temp.view(), *kernel, y0, y1);
+            }, 4 * kernelSize);
+            swap(temp);
+            return;
+        }
+
+        // Box cascade: horizontal passes in place, vertical passes ping-pong
+        const std::vector<int> boxes = boxesForGauss(sigma);
+        forEachBand([&](int y0, int y1) {
+            std::vector<uint8_t> line((static_cast<size_t>(width) + 2 * boxRadiusFor(boxes.back() / 2, width)) * channels);
+            for (int y = y0; y < y1; y++) {
+                for (int box : boxes) boxBlurRow(row(y), line.data(), width, channels, box / 2);
             }
+        });
+        for (int box : boxes) {
+            Parallel::forColumns(width, stride * height, [&](int x0, int x1) {
+                boxBlurColumns(view(), temp.view(), box / 2, x0, x1);
+            });
+            swap(temp);
         }
-        data = temp;
     }
 
     void addVignetteEffect(float strength = 0.5) {
-        float centerX = width / 2.0f;
-        float centerY = height / 2.0f;
-        float maxDist = std::sqrt(centerX * centerX + centerY * centerY);
-
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                float distFromCenter = std::sqrt(
-                    std::pow(x - centerX, 2) + 
-                    std::pow(y - centerY, 2)
-                );
-                
-                float vignetteMultiplier = 1.0f - (distFromCenter / maxDist) * strength;
-                vignetteMultiplier = std::max(0.0f, vignetteMultiplier);
-
-                for (int c = 0; c < channels; c++) {
-                    data[y][x][c] = std::clamp(
-                        static_cast<int>(data[y][x][c] * vignetteMultiplier), 
-                        0, 255
-                    );
+        addVignetteEffect(strength, 0, height);
+    }
+
+    // Vignette of a taller frame of which this image holds rows [top, top + height),
+    // for processing a frame strip by strip
+    void addVignetteEffect(float strength, int top, int frameHeight) {
+        forEachBand([&](int y0, int y1) {
+            withPixelLayout(format, [&](auto layout) {
+                for (int y = y0; y < y1; y++) {
+                    vignetteRow<decltype(layout)>(row(y), top + y, width, frameHeight, strength);
                 }
-            }
-        }
+            });
+        });
     }
 
     void reflectHorizontally() {
-        std::vector<std::vector<std::vector<uint8_t>>> temp = data;
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width / 2; x++) {
-                for (int c = 0; c < channels; c++) {
-                    std::swap(temp[y][x][c], temp[y][width - 1 - x][c]);
-                }
-            }
-        }
-        data = temp;
+        forEachBand([&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) reflectRow(row(y), width, channels);
+        });
     }
 
     void reflectVertically() {
-        std::vector<std::vector<std::vector<uint8_t>>> temp = data;
-        for (int y = 0; y < height / 2; y++) {
-            for (int x = 0; x < width; x++) {
-                for (int c = 0; c < channels; c++) {
-                    std::swap(temp[y][x][c], temp[height - 1 - y][x][c]);
-                }
+        const size_t rowBytes = static_cast<size_t>(width) * channels;
+        // Bands cover the top half; each row swaps with its mirror
+        Parallel::forRows(height / 2, stride * height, [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                std::swap_ranges(row(y), row(y) + rowBytes, row(height - 1 - y));
             }
+        });
+    }
+
+    // Quarter turns go through one cache-blocked transpose into a new buffer;
+    // rotate180 and the flips work in place
+    void transpose() { transposeInto(false, false); }
+    void rotate90() { transposeInto(false, true); }  // Clockwise
+    void rotate270() { transposeInto(true, false); } // Clockwise, i.e. 90 counter-clockwise
+
+    void rotate180() {
+        if (width == 0) return;
+        Parallel::forRows((height + 1) / 2, stride * height, [&](int y0, int y1) {
+            rotate180Rows(view(), y0, y1);
+        });
+    }
+
+    // Turns an image stored with EXIF Orientation `orientation` (1-8) upright;
+    // every case is at most one pass
+    void applyExifOrientation(int orientation) {
+        switch (orientation) {
+            case 2: reflectHorizontally(); break;
+            case 3: rotate180(); break;
+            case 4: reflectVertically(); break;
+            case 5: transpose(); break;
+            case 6: rotate90(); break;
+            case 7: transposeInto(true, true); break; // Transverse
+            case 8: rotate270(); break;
+            default: break; // 1 or unknown: already upright
         }
-        data = temp;
     }
 
-    // Edge Detection
-    void sobelEdgeDetection() {
-        std::vector<std::vector<std::vector<uint8_t>>> temp = data;
-        
-        // Sobel kernels
-        const std::vector<std::vector<int>> kernelX = {
-            {-1, 0, 1},
-            {-2, 0, 2},
-            {-1, 0, 1}
-        };
-        
-        const std::vector<std::vector<int>> kernelY = {
-            {-1, -2, -1},
-            {0, 0, 0},
-            {1, 2, 1}
-        };
-
-        for (int y = 1; y < height - 1; y++) {
-            for (int x = 1; x < width - 1; x++) {
-                for (int c = 0; c < channels; c++) {
-                    float gx = 0.0f, gy = 0.0f;
-                    
-                    // Apply kernels
-                    for (int i = -1; i <= 1; i++) {
-                        for (int j = -1; j <= 1; j++) {
-                            float pixel = data[y + i][x + j][c];
-                            gx += pixel * kernelX[i + 1][j + 1];
-                            gy += pixel * kernelY[i + 1][j + 1];
-                        }
-                    }
-                    
-                    // Calculate gradient magnitude
-                    float magnitude = std::sqrt(gx * gx + gy * gy);
-                    temp[y][x][c] = static_cast<uint8_t>(std::clamp(magnitude, 0.0f, 255.0f));
-                }
-            }
+    // Window onto the w x h pixels at (x, y), sharing this image's buffer: no
+    // copy, and edits made in place show through in both. Copy-construct
+    // from the crop for independent pixels.
+    Image crop(int x, int y, int w, int h) {
+        if (x < 0 || y < 0 || w < 0 || h < 0 || x > width - w || y > height - h) {
+            throw std::out_of_range("Crop outside the image");
         }
-        data = temp;
+        return wrap(row(y) + static_cast<size_t>(x) * channels, w, h, format, stride, buffer);
+    }
+
+    // Edge Detection
+    void sobelEdgeDetection() { detectEdges(EdgeOptions()); }
+
+    // Gradient magnitude of every pixel, borders included; one channel when
+    // options.luminance is set on a colour image
+    void detectEdges(const EdgeOptions& options) {
+        const bool gray = options.luminance && channels >= 3;
+        Image temp(width, height, gray ? PixelFormat::Gray8 : format, false);
+        // Each band reads one halo row above and below from the source
+        forEachBand([&](int y0, int y1) { edgeRows(view(), temp.view(), options, y0, y1); });
+        swap(temp);
+    }
+
+    // Canny edges of the luminance: a one-channel 0/255 map of thin edges.
+    // Magnitudes above `high` start an edge, ones above `low` continue it.
+    void cannyEdges(float low = 50, float high = 150, const EdgeOptions& options = EdgeOptions()) {
+        Image temp(width, height, PixelFormat::Gray8, false);
+        // Bands classify in parallel; linking weak pixels follows edges across bands
+        forEachBand([&](int y0, int y1) {
+            cannyClassifyRows(view(), temp.view(), options, low, high, y0, y1);
+        });
+        cannyHysteresis(temp.view());
+        swap(temp);
     }
 
     // Color Space Conversions
+    // Luminance of each pixel, from red, green and blue wherever the format
+    // keeps them; alpha is dropped
     void rgbToGrayscale() {
         if (channels < 3) return;
-        
-        std::vector<std::vector<std::vector<uint8_t>>> temp(
-            height, std::vector<std::vector<uint8_t>>(
-                width, std::vector<uint8_t>(1, 0)));
-
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                // Using luminosity method: 0.299R + 0.587G + 0.114B
-                float gray = 0.299f * data[y][x][0] + 
-                           0.587f * data[y][x][1] + 
-                           0.114f * data[y][x][2];
-                temp[y][x][0] = static_cast<uint8_t>(std::clamp(gray, 0.0f, 255.0f));
-            }
-        }
-        
-        data = temp;
-        channels = 1;
+
+        Image temp(width, height, PixelFormat::Gray8, false);
+
+        const ColorMatrix luminance = ColorMatrix::grayscale();
+        forEachBand([&](int y0, int y1) {
+            withPixelLayout(format, [&](auto layout) {
+                for (int y = y0; y < y1; y++) {
+                    luminance.applyRowToGray<decltype(layout)>(row(y), temp.row(y), width);
+                }
+            });
+        });
+
+        swap(temp);
     }
 
     void convertToSepia() {
-        if (channels < 3) return;
+        applyColorMatrix(ColorMatrix::sepia());
+    }
+
+    // Image Compression
+    void compressImage(float quality = 0.5) {
+        // Reduce color depth based on quality (clamped to [0, 1])
+        int colorReductionFactor = PointOp::quantizeStep(quality);
+        if (colorReductionFactor <= 1) return; // Nothing to quantize away
+
+        const PointKernels& kernels = pointKernels();
+        forEachSpan([&](uint8_t* p, size_t n) {
+            // Quantize pixel values
+            kernels.quantize(p, n, colorReductionFactor);
+        });
+    }
 
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                float r = data[y][x][0];
-                float g = data[y][x][1];
-                float b = data[y][x][2];
+    // Statistics
+    // One histogram per channel in a single pass; bands count into private
+    // bins and are merged at the end
+    std::vector<ChannelHistogram> histograms() const {
+        std::vector<ChannelHistogram> total(channels);
+        std::mutex merge;
+        forEachBand([&](int y0, int y1) {
+            std::vector<ChannelHistogram> band(channels);
+            histogramRows(view(), band.data(), 0, width, y0, y1);
+            std::lock_guard<std::mutex> lock(merge);
+            for (int c = 0; c < channels; c++) total[c] += band[c];
+        });
+        return total;
+    }
 
-                // Sepia tone calculation
-                float newR = std::min(255.0f, r * 0.393f + g * 0.769f + b * 0.189f);
-                float newG = std::min(255.0f, r * 0.349f + g * 0.686f + b * 0.168f);
-                float newB = std::min(255.0f, r * 0.272f + g * 0.534f + b * 0.131f);
+    // Automatic corrections. They read the histograms and apply lookup
+    // tables to the colour channels; alpha is kept.
 
-                data[y][x][0] = static_cast<uint8_t>(newR);
-                data[y][x][1] = static_cast<uint8_t>(newG);
-                data[y][x][2] = static_cast<uint8_t>(newB);
-            }
+    // Stretches each channel so that its `clip` darkest and brightest
+    // fraction of pixels become 0 and 255. Per channel, so casts are removed too.
+    void autoLevels(float clip = 0.005f) {
+        const std::vector<ChannelHistogram> counts = histograms();
+        std::vector<PointOp::Table> tables;
+        for (int c = 0; c < colourChannels(); c++) {
+            tables.push_back(levelsTable(counts[c].percentile(clip), counts[c].percentile(1 - clip)));
         }
+        applyLUT(PointOp::fromTables(tables));
     }
 
-    // Image Compression
-    void compressImage(float quality = 0.5) {
-        // Validate quality factor
-        quality = std::max(0.0f, std::min(1.0f, quality));
-
-        // Reduce color depth based on quality
-        int colorReductionFactor = static_cast<int>(256 * (1 - quality));
-
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                for (int c = 0; c < channels; c++) {
-                    // Quantize pixel values
-                    data[y][x][c] = 
-                        (data[y][x][c] / colorReductionFactor) * colorReductionFactor;
+    // Flattens the histogram of the colour channels taken together; one table
+    // for all of them keeps hues from shifting
+    void equalizeHistogram() {
+        const std::vector<ChannelHistogram> counts = histograms();
+        ChannelHistogram pooled;
+        for (int c = 0; c < colourChannels(); c++) pooled += counts[c];
+        applyLUT(PointOp::fromTables(std::vector<PointOp::Table>(colourChannels(), equalizationTable(pooled))));
+    }
+
+    // Contrast-limited adaptive equalization: a clipped equalization table
+    // per tile of a tiles x tiles grid, blended between tile centres.
+    // clipLimit caps each bin at that multiple of the mean bin count.
+    void applyClahe(float clipLimit = 2.0f, int tiles = 8) {
+        if (width == 0 || height == 0) return;
+        if (clipLimit <= 0 || tiles < 1) throw std::invalid_argument("CLAHE needs clipLimit > 0 and tiles >= 1");
+        const int tilesX = std::min(tiles, width), tilesY = std::min(tiles, height);
+        const int colour = colourChannels();
+
+        std::vector<PointOp::Table> tables(static_cast<size_t>(tilesX) * tilesY);
+        Parallel::forRows(tilesY, stride * height, [&](int ty0, int ty1) {
+            for (int ty = ty0; ty < ty1; ty++) {
+                for (int tx = 0; tx < tilesX; tx++) {
+                    std::vector<ChannelHistogram> counts(channels);
+                    histogramRows(view(), counts.data(), tx * width / tilesX, (tx + 1) * width / tilesX,
+                                  ty * height / tilesY, (ty + 1) * height / tilesY);
+                    ChannelHistogram pooled;
+                    for (int c = 0; c < colour; c++) pooled += counts[c];
+                    tables[static_cast<size_t>(ty) * tilesX + tx] = claheTable(pooled, clipLimit);
                 }
             }
-        }
+        });
+
+        const BilinearTaps xs(tilesX, width), ys(tilesY, height);
+        forEachBand([&](int y0, int y1) { claheRows(view(), colour, tables, tilesX, xs, ys, y0, y1); });
+    }
+
+    // Resampling
+    // Half the width and height (rounded up), each pixel the mean of a 2x2 block
+    Image halfSize() const {
+        Image half((width + 1) / 2, (height + 1) / 2, format, false);
+        // Bands of the output; each reads two source rows per output row
+        Parallel::forRows(half.height, stride * height, [&](int y0, int y1) {
+            halveRows(view(), half.view(), y0, y1);
+        });
+        return half;
+    }
+
+    // Bilinear resample to newWidth x newHeight. Shrinking by more than 2x
+    // skips source pixels; go through halfSize() first (see pyramid.hpp).
+    Image resized(int newWidth, int newHeight) const {
+        if (newWidth <= 0 || newHeight <= 0) throw std::invalid_argument("Invalid resize dimensions");
+        if (width == 0 || height == 0) return Image(newWidth, newHeight, format);
+        Image out(newWidth, newHeight, format, false);
+
+        const BilinearTaps xs(width, newWidth), ys(height, newHeight);
+        Parallel::forRows(newHeight, out.stride * newHeight, [&](int y0, int y1) {
+            resizeBilinearRows(view(), out.view(), xs, ys, y0, y1);
+        });
+        return out;
     }
 
 
 private:
-    std::vector<std::vector<float>> createGaussianKernel(int size) {
-        std::vector<std::vector<float>> kernel(
-            size, std::vector<float>(size));
-        float sigma = size / 6.0f;
-        float sum = 0.0f;
-        
-        for (int y = 0; y < size; y++) {
-            for (int x = 0; x < size; x++) {
-                int nx = x - (size / 2);
-                int ny = y - (size / 2);
-                float value = std::exp(-(nx * nx + ny * ny) / (2 * sigma * sigma));
-                kernel[y][x] = value;
-                sum += value;
-            }
+    Image() : stride(0), width(0), height(0), channels(0), format(PixelFormat::Gray8) {}
+
+    // Channels the colour corrections touch; alpha is left alone
+    int colourChannels() const { return hasAlpha(format) ? channels - 1 : channels; }
+
+    Image(int width, int height, int channels, bool zeroFill)
+        : Image(width, height, defaultPixelFormat(channels), zeroFill) {}
+
+    // Takes an aligned buffer from the shared pool; `zeroFill` is skipped for
+    // scratch images whose every pixel is about to be overwritten.
+    Image(int width, int height, PixelFormat format, bool zeroFill)
+        : stride(alignedStride(width, pixelFormatChannels(format))),
+          width(width), height(height), channels(pixelFormatChannels(format)), format(format) {
+        if (width < 0 || height < 0) {
+            throw std::invalid_argument("Invalid image dimensions");
         }
-        
-        // Normalize kernel
-        for (int y = 0; y < size; y++) {
-            for (int x = 0; x < size; x++) {
-                kernel[y][x] /= sum;
-            }
+        buffer = BufferPool::shared().acquire(stride * height);
+        if (zeroFill && buffer) {
+            std::memset(buffer.get(), 0, stride * height);
         }
-        
-        return kernel;
+    }
+
+    // Replaces the image by its transpose, reading source columns and/or rows
+    // backwards (see geometry.hpp)
+    void transposeInto(bool reverseColumns, bool reverseRows) {
+        Image temp(height, width, format, false);
+        Parallel::forRows(temp.height, stride * height, [&](int y0, int y1) {
+            transposeRows(view(), temp.view(), reverseColumns, reverseRows, y0, y1);
+        });
+        swap(temp);
+    }
+
+    // Runs fn(y0, y1) over row bands of this image on the shared pool
+    void forEachBand(const std::function<void(int, int)>& fn, int minRows = 1) const {
+        Parallel::forRows(height, stride * height, fn, minRows);
+    }
+
+    // Runs fn(ptr, count) over all pixel bytes; a band is one run when rows
+    // have no padding between them. With alpha, fn runs on short runs of
+    // pixels whose alpha is saved first and put back after, so byte kernels
+    // leave it alone.
+    void forEachSpan(const std::function<void(uint8_t*, size_t)>& fn) {
+        const size_t rowBytes = static_cast<size_t>(width) * channels;
+        if (hasAlpha(format)) {
+            forEachBand([&](int y0, int y1) {
+                withPixelLayout(format, [&](auto layout) {
+                    constexpr int step = decltype(layout)::channels;
+                    // One chunk stays in L1 between fn and the restore; the fixed
+                    // sizes let the copy and the select vectorise
+                    constexpr int kPixels = 256, kBytes = kPixels * step;
+                    uint8_t saved[kBytes];
+                    for (int y = y0; y < y1; y++) {
+                        uint8_t* p = row(y);
+                        int x0 = 0;
+                        for (; x0 + kPixels <= width; x0 += kPixels, p += kBytes) {
+                            std::memcpy(saved, p, kBytes);
+                            fn(p, kBytes);
+                            for (int i = 0; i < kBytes; i++) {
+                                if (i % step == step - 1) p[i] = saved[i];
+                            }
+                        }
+                        const int n = width - x0;
+                        if (n == 0) continue;
+                        std::memcpy(saved, p, static_cast<size_t>(n) * step);
+                        fn(p, static_cast<size_t>(n) * step);
+                        for (int x = 0; x < n; x++) p[x * step + step - 1] = saved[x * step + step - 1];
+                    }
+                });
+            });
+            return;
+        }
+        forEachBand([&](int y0, int y1) {
+            if (rowBytes == stride) {
+                fn(row(y0), rowBytes * (y1 - y0));
+                return;
+            }
+            for (int y = y0; y < y1; y++) fn(row(y), rowBytes);
+        });
     }
 };
 
-#endif // IMAGE_PROCESSING_H
\ No newline at end of file
+#endif // IMAGE_PROCESSING_H
@@ -0,0 +1,106 @@
+// image_view.hpp
+#ifndef IMAGE_VIEW_H
+#define IMAGE_VIEW_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "pixel_format.hpp"
+
+
+// Every row of a buffer Image allocates starts on a 64-byte boundary (one cache
+// line, one AVX-512 register). Wrapped external buffers may not be aligned, so
+// vector code uses unaligned loads and stores.
+constexpr size_t kRowAlignment = 64;
+
+inline size_t alignedStride(int width, int channels) {
+    size_t rowBytes = static_cast<size_t>(width) * channels;
+    return (rowBytes + kRowAlignment - 1) / kRowAlignment * kRowAlignment;
+}
+
+
+// Bytes currently held by aligned pixel buffers, for memory metrics
+inline std::atomic<size_t>& alignedBytesInUse() {
+    static std::atomic<size_t> bytes{0};
+    return bytes;
+}
+
+struct AlignedDeleter {
+    size_t bytes = 0;
+
+    void operator()(uint8_t* ptr) const {
+        alignedBytesInUse().fetch_sub(bytes, std::memory_order_relaxed);
+        std::free(ptr);
+    }
+};
+
+using AlignedBuffer = std::unique_ptr<uint8_t, AlignedDeleter>;
+
+inline AlignedBuffer allocateAligned(size_t bytes) {
+    if (bytes == 0) return AlignedBuffer();
+
+    // aligned_alloc wants the size to be a multiple of the alignment
+    size_t rounded = (bytes + kRowAlignment - 1) / kRowAlignment * kRowAlignment;
+    void* ptr = std::aligned_alloc(kRowAlignment, rounded);
+    if (!ptr) throw std::bad_alloc();
+    alignedBytesInUse().fetch_add(rounded, std::memory_order_relaxed);
+    return AlignedBuffer(static_cast<uint8_t*>(ptr), AlignedDeleter{rounded});
+}
+
+
+// Non-owning window onto interleaved 8-bit pixels. `stride` is the distance
+// in bytes between the starts of two consecutive rows; `format` says which
+// colour each channel holds.
+template <typename T>
+struct BasicImageView {
+    T* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    size_t stride = 0;
+    PixelFormat format = PixelFormat::Gray8;
+
+    BasicImageView() = default;
+    BasicImageView(T* data, int width, int height, int channels, size_t stride)
+        : BasicImageView(data, width, height, channels, stride, defaultPixelFormat(channels)) {}
+    BasicImageView(T* data, int width, int height, int channels, size_t stride, PixelFormat format)
+        : data(data), width(width), height(height), channels(channels), stride(stride), format(format) {}
+
+    // A mutable view can always be read through a const one
+    template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T>>>
+    BasicImageView(const BasicImageView<U>& other)
+        : data(other.data), width(other.width), height(other.height),
+          channels(other.channels), stride(other.stride), format(other.format) {}
+
+    T* row(int y) const { return data + static_cast<size_t>(y) * stride; }
+    T* pixel(int y, int x) const { return row(y) + static_cast<size_t>(x) * channels; }
+
+    // Bytes actually occupied by pixels in one row (stride minus padding)
+    size_t rowBytes() const { return static_cast<size_t>(width) * channels; }
+    bool empty() const { return width == 0 || height == 0; }
+};
+
+using ImageView = BasicImageView<uint8_t>;
+using ConstImageView = BasicImageView<const uint8_t>;
+
+
+// Copies the pixels of `src` into `dst`; both must have the same shape.
+inline void copyPixels(ConstImageView src, ImageView dst) {
+    if (src.empty()) return;
+    const size_t rowBytes = src.rowBytes();
+    if (src.stride == dst.stride && rowBytes == src.stride) {
+        std::memcpy(dst.data, src.data, rowBytes * src.height);
+        return;
+    }
+    for (int y = 0; y < src.height; y++) {
+        std::memcpy(dst.row(y), src.row(y), rowBytes);
+    }
+}
+
+#endif // IMAGE_VIEW_H
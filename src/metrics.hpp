@@ -0,0 +1,240 @@
+// metrics.hpp
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Counters, gauges and latency histograms rendered in the Prometheus text
+// format. Recording only touches relaxed atomics, so it is safe and cheap on
+// any request thread; the registry lock is only taken to create a series and
+// to render a scrape. Create series up front and keep the references.
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+class Counter {
+public:
+    void inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+class Gauge {
+public:
+    void add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+    void set(int64_t n) { value.store(n, std::memory_order_relaxed); }
+    int64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value{0};
+};
+
+// Fixed buckets from 50 us to 10 s, roughly 1-2.5-5 per decade
+class Histogram {
+public:
+    static constexpr size_t kBuckets = 18;
+    static constexpr std::array<double, kBuckets> kBounds = {
+        0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+        0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 1e300 // +Inf
+    };
+
+    void observe(double seconds) {
+        size_t bucket = 0;
+        while (seconds > kBounds[bucket] && bucket + 1 < kBuckets) bucket++;
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        sumNanos.fetch_add(static_cast<uint64_t>(seconds * 1e9), std::memory_order_relaxed);
+    }
+
+    uint64_t bucketCount(size_t bucket) const { return counts[bucket].load(std::memory_order_relaxed); }
+    double sum() const { return sumNanos.load(std::memory_order_relaxed) * 1e-9; }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> counts{};
+    std::atomic<uint64_t> sumNanos{0};
+};
+
+
+// Monotonic timer for consecutive stages of one request
+class Stopwatch {
+public:
+    Stopwatch() : last(Clock::now()) {}
+
+    // Seconds since construction or the previous lap
+    double lap() {
+        Clock::time_point now = Clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+        return seconds;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point last;
+};
+
+// Records the lifetime of a scope into a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram) : histogram(histogram) {}
+    ~ScopedTimer() { histogram.observe(watch.lap()); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram;
+    Stopwatch watch;
+};
+
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& global() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    Counter& counter(const std::string& name, const std::string& help, const MetricLabels& labels = {}) {
+        return series<Counter>(name, help, "counter", labels);
+    }
+
+    Gauge& gauge(const std::string& name, const std::string& help, const MetricLabels& labels = {}) {
+        return series<Gauge>(name, help, "gauge", labels);
+    }
+
+    Histogram& histogram(const std::string& name, const std::string& help, const MetricLabels& labels = {}) {
+        return series<Histogram>(name, help, "histogram", labels);
+    }
+
+    // Gauge whose value is read from `read` at scrape time
+    void gaugeFunction(const std::string& name, const std::string& help, std::function<double()> read,
+                       const MetricLabels& labels = {}) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Family& family = familyFor(name, help, "gauge");
+        family.series.push_back({labels, nullptr, std::move(read)});
+    }
+
+    // Counter kept elsewhere (e.g. under another component's lock), read at scrape time
+    void counterFunction(const std::string& name, const std::string& help, std::function<double()> read,
+                         const MetricLabels& labels = {}) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Family& family = familyFor(name, help, "counter");
+        family.series.push_back({labels, nullptr, std::move(read)});
+    }
+
+    // Prometheus text exposition format, version 0.0.4
+    std::string render() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string out;
+        for (const auto& [name, family] : families) {
+            out += "# HELP " + name + " " + family.help + "\n";
+            out += "# TYPE " + name + " " + family.type + "\n";
+            for (const Series& s : family.series) {
+                if (s.read) {
+                    out += name + labelText(s.labels) + " " + number(s.read()) + "\n";
+                } else if (family.type == "counter") {
+                    out += name + labelText(s.labels) + " " +
+                           std::to_string(static_cast<const Counter*>(s.metric.get())->get()) + "\n";
+                } else if (family.type == "gauge") {
+                    out += name + labelText(s.labels) + " " +
+                           std::to_string(static_cast<const Gauge*>(s.metric.get())->get()) + "\n";
+                } else {
+                    renderHistogram(out, name, s.labels, *static_cast<const Histogram*>(s.metric.get()));
+                }
+            }
+        }
+        return out;
+    }
+
+private:
+    struct Series {
+        MetricLabels labels;
+        std::shared_ptr<void> metric; // Counter, Gauge or Histogram, by family type
+        std::function<double()> read;
+    };
+
+    struct Family {
+        std::string help;
+        std::string type;
+        std::vector<Series> series;
+    };
+
+    mutable std::mutex mutex;
+    std::map<std::string, Family> families;
+
+    template <typename Metric>
+    Metric& series(const std::string& name, const std::string& help, const char* type,
+                   const MetricLabels& labels) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Family& family = familyFor(name, help, type);
+        for (Series& s : family.series) {
+            if (s.labels == labels && s.metric) return *static_cast<Metric*>(s.metric.get());
+        }
+        auto metric = std::make_shared<Metric>();
+        family.series.push_back({labels, metric, nullptr});
+        return *metric;
+    }
+
+    Family& familyFor(const std::string& name, const std::string& help, const std::string& type) {
+        Family& family = families[name];
+        if (family.type.empty()) {
+            family.help = help;
+            family.type = type;
+        } else if (family.type != type) {
+            throw std::logic_error("Metric " + name + " registered as " + family.type + " and " + type);
+        }
+        return family;
+    }
+
+    static void renderHistogram(std::string& out, const std::string& name, const MetricLabels& labels,
+                                const Histogram& h) {
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < Histogram::kBuckets; b++) {
+            cumulative += h.bucketCount(b);
+            MetricLabels withLe = labels;
+            withLe.emplace_back("le", b + 1 == Histogram::kBuckets ? "+Inf" : number(Histogram::kBounds[b]));
+            out += name + "_bucket" + labelText(withLe) + " " + std::to_string(cumulative) + "\n";
+        }
+        // Bucket and total counts are read separately, so report the bucket sum
+        out += name + "_sum" + labelText(labels) + " " + number(h.sum()) + "\n";
+        out += name + "_count" + labelText(labels) + " " + std::to_string(cumulative) + "\n";
+    }
+
+    static std::string labelText(const MetricLabels& labels) {
+        if (labels.empty()) return "";
+        std::string out = "{";
+        for (size_t i = 0; i < labels.size(); i++) {
+            if (i) out += ",";
+            out += labels[i].first + "=\"";
+            for (char c : labels[i].second) {
+                if (c == '\\' || c == '"') out += '\\';
+                if (c == '\n') { out += "\\n"; continue; }
+                out += c;
+            }
+            out += "\"";
+        }
+        return out + "}";
+    }
+
+    static std::string number(double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.9g", value);
+        return text;
+    }
+};
+
+#endif // METRICS_H
@@ -0,0 +1,133 @@
+// opencv_interop.hpp
+#ifndef OPENCV_INTEROP_H
+#define OPENCV_INTEROP_H
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "image_processing.hpp"
+#include "exif.hpp"
+#include "image_header.hpp"
+#include "output_format.hpp"
+
+
+// Conversions between Image and cv::Mat that share pixels instead of copying
+// them. Only the one header that needs OpenCV includes it; the rest of src/
+// stays free of it.
+
+// Takes over the pixels of `mat`. 8-bit Mats with 1-4 channels are adopted as
+// they are (the Image holds a reference to them); other depths are converted
+// to 8-bit first, which is the only case that copies.
+inline Image imageFromMat(cv::Mat mat) {
+    if (mat.empty()) {
+        throw std::invalid_argument("Empty cv::Mat");
+    }
+    if (mat.channels() > 4) {
+        throw std::invalid_argument("Unsupported channel count: " + std::to_string(mat.channels()));
+    }
+    if (mat.depth() != CV_8U) {
+        // 16-bit PNG/TIFF scale down to 0..255, float images are taken as 0..1
+        double scale = mat.depth() == CV_16U ? 1.0 / 257.0 : (mat.depth() == CV_32F ? 255.0 : 1.0);
+        cv::Mat converted;
+        mat.convertTo(converted, CV_MAKETYPE(CV_8U, mat.channels()), scale);
+        mat = converted;
+    }
+
+    auto owner = std::make_shared<cv::Mat>(std::move(mat));
+    return Image::wrap(owner->data, owner->cols, owner->rows, owner->channels(),
+                       owner->step[0], owner);
+}
+
+// cv::Mat header over the image's pixels. Nothing is copied: the Mat is only
+// valid while `image` is alive and until an operation replaces its buffer.
+inline cv::Mat matView(Image& image) {
+    return cv::Mat(image.getHeight(), image.getWidth(), CV_8UC(image.getChannels()),
+                   image.row(0), image.getStride());
+}
+
+// Read-only variant
+inline cv::Mat matView(const Image& image) {
+    return matView(const_cast<Image&>(image));
+}
+
+// The pixels in the BGR(A) order imwrite/imencode expect: a view when they
+// already are (as everything OpenCV decoded is), a swapped copy for RGB(A)
+inline cv::Mat matForWriting(const Image& image) {
+    const PixelFormat format = image.getPixelFormat();
+    if (format != PixelFormat::RGB8 && format != PixelFormat::RGBA8) return matView(image);
+    cv::Mat bgr;
+    cv::cvtColor(matView(image), bgr, format == PixelFormat::RGB8 ? cv::COLOR_RGB2BGR : cv::COLOR_RGBA2BGRA);
+    return bgr;
+}
+
+
+// IMREAD_UNCHANGED leaves EXIF orientation alone, so both loaders turn the
+// image upright themselves: one pass instead of OpenCV's flip-and-copy chain
+inline Image convertToImageClass(const std::string& imagePath) {
+    cv::Mat img = cv::imread(imagePath, cv::IMREAD_UNCHANGED);
+    if (img.empty()) {
+        throw std::runtime_error("Failed to load image: " + imagePath);
+    }
+    Image image = imageFromMat(std::move(img));
+    image.applyExifOrientation(exifOrientationOfFile(imagePath));
+    return image;
+}
+
+inline void saveImage(const Image& myImage, const std::string& outputPath) {
+    if (!cv::imwrite(outputPath, matForWriting(myImage))) {
+        throw std::runtime_error("Failed to save image: " + outputPath);
+    }
+}
+
+// Decodes an encoded image (JPEG, PNG, ...) held in memory. The header is
+// read first and the image refused (ImageTooLarge) when its dimensions pass
+// `limits`, so no pixel memory is allocated for it; formats whose header we
+// cannot read are refused too. The bytes are decoded in place, not copied.
+inline Image decodeImage(const std::string& bytes, const DecodeLimits& limits = DecodeLimits()) {
+    const ImageHeader header = inspectImageHeader(bytes);
+    if (header.format.empty()) {
+        throw std::invalid_argument("Unrecognised image format");
+    }
+    if (!header.known()) {
+        throw std::invalid_argument("Could not read the " + header.format + " image dimensions");
+    }
+    limits.check(header);
+    if (bytes.size() > static_cast<size_t>(INT32_MAX)) {
+        throw ImageTooLarge("Encoded image too large");
+    }
+    const cv::Mat data(1, static_cast<int>(bytes.size()), CV_8UC1, const_cast<char*>(bytes.data()));
+    cv::Mat img = cv::imdecode(data, cv::IMREAD_UNCHANGED);
+    if (img.empty()) {
+        throw std::invalid_argument("Could not decode image data");
+    }
+    Image image = imageFromMat(std::move(img));
+    image.applyExifOrientation(exifOrientation(bytes));
+    return image;
+}
+
+// Encodes to the format named by `extension` (".jpg", ".png", ...)
+inline std::string encodeImage(const Image& image, const std::string& extension = ".jpg") {
+    std::vector<uchar> encoded;
+    if (!cv::imencode(extension, matForWriting(image), encoded)) {
+        throw std::runtime_error("Failed to encode image as " + extension);
+    }
+    return std::string(encoded.begin(), encoded.end());
+}
+
+// Encodes as negotiated, with the format's quality setting
+inline std::string encodeImage(const Image& image, const OutputFormat& format) {
+    std::vector<int> params;
+    if (format.kind == OutputFormat::Jpeg) params = {cv::IMWRITE_JPEG_QUALITY, format.quality};
+    if (format.kind == OutputFormat::WebP) params = {cv::IMWRITE_WEBP_QUALITY, format.quality};
+    std::vector<uchar> encoded;
+    if (!cv::imencode(format.extension(), matForWriting(image), encoded, params)) {
+        throw std::runtime_error(std::string("Failed to encode image as ") + format.extension());
+    }
+    return std::string(encoded.begin(), encoded.end());
+}
+
+#endif // OPENCV_INTEROP_H
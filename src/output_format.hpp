@@ -0,0 +1,109 @@
+// output_format.hpp
+#ifndef OUTPUT_FORMAT_H
+#define OUTPUT_FORMAT_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+
+// Encoding a response is asked for in: the format, and the quality for the
+// lossy ones. Chosen per request by negotiate(); encodeImage() in
+// opencv_interop.hpp turns it into imencode parameters.
+struct OutputFormat {
+    enum Kind { Jpeg, Png, WebP } kind = Jpeg;
+    int quality = 95; // 1-100; ignored for PNG, which is lossless
+
+    static constexpr int kDefaultJpegQuality = 95; // OpenCV's own default, as before negotiation
+    static constexpr int kDefaultWebPQuality = 80;
+
+    const char* extension() const {
+        switch (kind) {
+            case Png: return ".png";
+            case WebP: return ".webp";
+            default: return ".jpg";
+        }
+    }
+
+    const char* contentType() const {
+        switch (kind) {
+            case Png: return "image/png";
+            case WebP: return "image/webp";
+            default: return "image/jpeg";
+        }
+    }
+
+    // Distinguishes encodings of the same pixels in cache keys and ETags
+    std::string suffix() const {
+        return kind == Png ? "png" : std::string(extension() + 1) + "-q" + std::to_string(quality);
+    }
+
+    // `format` (jpeg, jpg, png or webp) wins when given; otherwise the type
+    // with the highest q in the Accept header among the three, with JPEG for
+    // wildcards, a missing header or no supported type. `quality` <= 0 takes
+    // the format's default. Throws invalid_argument for unknown formats.
+    static OutputFormat negotiate(const std::string& format, const std::string& accept, int quality = 0) {
+        OutputFormat out;
+        if (!format.empty()) {
+            out.kind = fromName(format);
+        } else {
+            out.kind = fromAccept(accept);
+        }
+        if (quality > 100) throw std::invalid_argument("Quality must be 1-100");
+        out.quality = quality > 0 ? quality : (out.kind == WebP ? kDefaultWebPQuality : kDefaultJpegQuality);
+        if (out.kind == Png) out.quality = 0;
+        return out;
+    }
+
+private:
+    static std::string lower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    static Kind fromName(const std::string& name) {
+        const std::string key = lower(name);
+        if (key == "jpeg" || key == "jpg") return Jpeg;
+        if (key == "png") return Png;
+        if (key == "webp") return WebP;
+        throw std::invalid_argument("Unknown format: " + name + " (use jpeg, png or webp)");
+    }
+
+    // Ties go to the type listed first; q=0 rules a type out
+    static Kind fromAccept(const std::string& accept) {
+        Kind best = Jpeg;
+        double bestQ = 0;
+        std::stringstream ranges(accept);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            std::stringstream fields(range);
+            std::string type, parameter;
+            std::getline(fields, type, ';');
+            double q = 1.0;
+            while (std::getline(fields, parameter, ';')) {
+                parameter.erase(0, parameter.find_first_not_of(" \t"));
+                if (parameter.rfind("q=", 0) == 0) q = std::atof(parameter.c_str() + 2);
+            }
+            type.erase(0, type.find_first_not_of(" \t"));
+            type.erase(type.find_last_not_of(" \t") + 1);
+            type = lower(type);
+
+            Kind kind;
+            if (type == "image/jpeg") kind = Jpeg;
+            else if (type == "image/png") kind = Png;
+            else if (type == "image/webp") kind = WebP;
+            else continue; // Wildcards and other types leave the default
+            if (q > bestQ) {
+                best = kind;
+                bestQ = q;
+            }
+        }
+        return best;
+    }
+};
+
+#endif // OUTPUT_FORMAT_H
@@ -0,0 +1,565 @@
+// pipeline.hpp
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+#include "image_processing.hpp"
+
+
+enum class OpType {
+    Brightness,
+    Contrast,
+    Saturation,
+    Invert,
+    GaussianBlur,
+    Vignette,
+    ReflectHorizontally,
+    ReflectVertically,
+    EdgeDetect,
+    Grayscale,
+    Sepia,
+    Compress,
+    HueRotate,
+    Canny,
+    AutoLevels,
+    Equalize,
+    Clahe
+};
+
+// One recorded Image operation. `value` is the method's argument (delta,
+// factor, kernel size, strength, quality or degrees); `extra` is the blur sigma.
+// Edge detection keeps its EdgeOptions::flags() in `value`; Canny its low and
+// high thresholds in `value` and `extra` (0 means 50 and three times low);
+// auto-levels its clip fraction (0 means 0.005); CLAHE its clip limit and
+// tile count (0 means 2 and 8).
+struct Operation {
+    OpType type;
+    float value = 0.0f;
+    float extra = 0.0f;
+
+    // Names follow the HTTP routes; "blur", "vignette" and "sobel" are accepted too
+    static Operation fromName(const std::string& name, float value = 0.0f, float extra = 0.0f) {
+        std::string key = name;
+        std::transform(key.begin(), key.end(), key.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+        for (const auto& entry : names()) {
+            if (key == entry.second) return checked({entry.first, value, extra});
+        }
+        if (key == "blur") return checked({OpType::GaussianBlur, value, extra});
+        if (key == "vignette") return checked({OpType::Vignette, value, extra});
+        if (key == "sobel") return checked({OpType::EdgeDetect, value, extra});
+        throw std::invalid_argument("Unknown operation: " + name);
+    }
+
+    std::string name() const {
+        for (const auto& entry : names()) {
+            if (entry.first == type) return entry.second;
+        }
+        return "unknown";
+    }
+
+    bool hasValue() const {
+        return type != OpType::Invert && type != OpType::ReflectHorizontally &&
+               type != OpType::ReflectVertically && type != OpType::Grayscale &&
+               type != OpType::Sepia && type != OpType::Equalize &&
+               ((type != OpType::EdgeDetect && type != OpType::Canny && type != OpType::AutoLevels &&
+                 type != OpType::Clahe) || value != 0.0f);
+    }
+
+    // Pure functions of one byte, fusable into a PointOp
+    bool isPointOp() const {
+        return type == OpType::Brightness || type == OpType::Contrast ||
+               type == OpType::Invert || type == OpType::Compress;
+    }
+
+    // Operations that need the whole frame before they can produce any row:
+    // they run on their own and cannot be split into strips
+    bool isWholeFrame() const {
+        return type == OpType::Canny || type == OpType::AutoLevels || type == OpType::Equalize ||
+               type == OpType::Clahe;
+    }
+
+    // Linear maps of the colour channels, fusable into a ColorMatrix
+    bool isColorMatrixOp() const {
+        return type == OpType::Saturation || type == OpType::Sepia || type == OpType::HueRotate;
+    }
+
+    ColorMatrix toColorMatrix() const {
+        switch (type) {
+            case OpType::Saturation: return ColorMatrix::saturation(value);
+            case OpType::Sepia: return ColorMatrix::sepia();
+            case OpType::HueRotate: return ColorMatrix::hueRotate(value);
+            default: throw std::logic_error("Not a colour matrix operation: " + name());
+        }
+    }
+
+    PointOp toPointOp() const {
+        switch (type) {
+            case OpType::Brightness: return PointOp::brightness(static_cast<int>(value));
+            case OpType::Contrast: return PointOp::contrast(value);
+            case OpType::Invert: return PointOp::invert();
+            case OpType::Compress: return PointOp::posterize(value);
+            default: throw std::logic_error("Not a point operation: " + name());
+        }
+    }
+
+    // Runs this operation on its own, exactly like the Image method
+    void applyTo(Image& image) const {
+        switch (type) {
+            case OpType::Brightness: image.brightnessAdjust(static_cast<int>(value)); break;
+            case OpType::Contrast: image.contrastAdjust(value); break;
+            case OpType::Saturation: image.adjustSaturation(value); break;
+            case OpType::Invert: image.invert(); break;
+            case OpType::GaussianBlur: image.applyGaussianBlur(static_cast<int>(value), extra); break;
+            case OpType::Vignette: image.addVignetteEffect(value); break;
+            case OpType::ReflectHorizontally: image.reflectHorizontally(); break;
+            case OpType::ReflectVertically: image.reflectVertically(); break;
+            case OpType::EdgeDetect: image.detectEdges(edgeOptions()); break;
+            case OpType::Grayscale: image.rgbToGrayscale(); break;
+            case OpType::Sepia: image.convertToSepia(); break;
+            case OpType::Compress: image.compressImage(value); break;
+            case OpType::HueRotate: image.hueRotate(value); break;
+            case OpType::Canny: {
+                const float low = value > 0 ? value : 50.0f;
+                image.cannyEdges(low, extra > 0 ? extra : 3 * low);
+                break;
+            }
+            case OpType::AutoLevels: image.autoLevels(value > 0 ? value : 0.005f); break;
+            case OpType::Equalize: image.equalizeHistogram(); break;
+            case OpType::Clahe:
+                image.applyClahe(value > 0 ? value : 2.0f, extra > 0 ? static_cast<int>(extra) : 8);
+                break;
+        }
+    }
+
+    // Parameters from requests are checked before they reach any int cast
+    // or allocation, with the limits of the single-operation routes; throws
+    // std::invalid_argument. Brightness is clamped, since deltas beyond 255
+    // all give the same result.
+    static Operation checked(Operation op) {
+        auto fail = [&](const std::string& what) {
+            throw std::invalid_argument(op.name() + ": " + what);
+        };
+        if (!std::isfinite(op.value) || !std::isfinite(op.extra)) fail("parameters must be finite");
+        auto isInteger = [](float v) { return v == std::floor(v); };
+
+        switch (op.type) {
+            case OpType::Brightness: op.value = std::clamp(op.value, -255.0f, 255.0f); break;
+            case OpType::GaussianBlur: checkBlurArguments(op.value, op.extra); break;
+            case OpType::EdgeDetect:
+                if (op.value < 0 || op.value > 7 || !isInteger(op.value)) fail("flags must be an integer in [0, 7]");
+                break;
+            case OpType::Canny:
+                if (op.value < 0 || op.extra < 0 || op.value > kMaxCannyThreshold || op.extra > kMaxCannyThreshold) {
+                    fail("thresholds must be in [0, " + std::to_string(int(kMaxCannyThreshold)) + "]");
+                }
+                if (op.value > 0 && op.extra > 0 && op.extra < op.value) fail("thresholds must satisfy low <= high");
+                break;
+            case OpType::AutoLevels:
+                if (op.value < 0 || op.value >= 0.5f) fail("clip must be in [0, 0.5)");
+                break;
+            case OpType::Clahe:
+                if (op.value < 0) fail("clip must not be negative");
+                if (op.extra < 0 || op.extra > 64 || !isInteger(op.extra)) fail("tiles must be an integer in [1, 64], or 0 for 8");
+                break;
+            default: break;
+        }
+        return op;
+    }
+
+    EdgeOptions edgeOptions() const { return EdgeOptions::fromFlags(static_cast<int>(value)); }
+
+    // Channels of the result when run on an image with `channels`
+    int outputChannels(int channels) const {
+        if (type == OpType::Canny) return 1;
+        if (channels < 3) return channels; // Grayscale and luminance edges leave these as they are
+        if (type == OpType::Grayscale || (type == OpType::EdgeDetect && edgeOptions().luminance)) return 1;
+        return channels;
+    }
+
+private:
+    static const std::vector<std::pair<OpType, std::string>>& names() {
+        static const std::vector<std::pair<OpType, std::string>> table = {
+            {OpType::Brightness, "brightness"},
+            {OpType::Contrast, "contrast"},
+            {OpType::Saturation, "saturation"},
+            {OpType::Invert, "invert"},
+            {OpType::GaussianBlur, "gaussianblur"},
+            {OpType::Vignette, "vignetteffect"},
+            {OpType::ReflectHorizontally, "reflecthorizontally"},
+            {OpType::ReflectVertically, "reflectvertically"},
+            {OpType::EdgeDetect, "detectedge"},
+            {OpType::Grayscale, "grayscale"},
+            {OpType::Sepia, "sepia"},
+            {OpType::Compress, "compress"},
+            {OpType::HueRotate, "huerotate"},
+            {OpType::Canny, "canny"},
+            {OpType::AutoLevels, "autolevels"},
+            {OpType::Equalize, "equalize"},
+            {OpType::Clahe, "clahe"},
+        };
+        return table;
+    }
+};
+
+
+// Deferred chain of Image operations. Operations are only recorded until
+// execute(), which plans the whole chain at once:
+//  - adjacent point ops collapse into one PointOp lookup table, and adjacent
+//    colour ops (saturation, sepia, hue rotation, grayscale) into one
+//    ColorMatrix wherever the earlier ones cannot clip (the result then only
+//    differs by the intermediate truncation, a few levels at most);
+//  - point, colour, vignette and horizontal-flip ops run together row by row
+//    in a single pass over the image;
+//  - the row ops that follow a blur or edge detection run on each output band
+//    as soon as it is produced, while it is still in cache;
+//  - work whose result is discarded is skipped: colour ops on images that are
+//    (or have become) single-channel and pairs of identical flips.
+//
+//   Pipeline().brightness(20).contrast(1.2f).gaussianBlur(5).grayscale().execute(image);
+class Pipeline {
+public:
+    Pipeline() = default;
+    explicit Pipeline(std::vector<Operation> ops) : ops(std::move(ops)) {}
+
+    Pipeline& add(const Operation& op) { ops.push_back(op); return *this; }
+
+    Pipeline& brightness(int delta) { return add({OpType::Brightness, static_cast<float>(std::clamp(delta, -255, 255))}); }
+    Pipeline& contrast(float factor) { return add({OpType::Contrast, factor}); }
+    Pipeline& saturation(float factor) { return add({OpType::Saturation, factor}); }
+    Pipeline& invert() { return add({OpType::Invert}); }
+    Pipeline& gaussianBlur(int kernelSize, float sigma = 0.0f) {
+        return add({OpType::GaussianBlur, static_cast<float>(kernelSize), sigma});
+    }
+    Pipeline& vignette(float strength) { return add({OpType::Vignette, strength}); }
+    Pipeline& reflectHorizontally() { return add({OpType::ReflectHorizontally}); }
+    Pipeline& reflectVertically() { return add({OpType::ReflectVertically}); }
+    Pipeline& edgeDetect(const EdgeOptions& options = EdgeOptions()) {
+        return add({OpType::EdgeDetect, static_cast<float>(options.flags())});
+    }
+    Pipeline& canny(float low = 50, float high = 150) { return add({OpType::Canny, low, high}); }
+    Pipeline& autoLevels(float clip = 0.005f) { return add({OpType::AutoLevels, clip}); }
+    Pipeline& equalize() { return add({OpType::Equalize}); }
+    Pipeline& clahe(float clipLimit = 2.0f, int tiles = 8) {
+        return add({OpType::Clahe, clipLimit, static_cast<float>(tiles)});
+    }
+    Pipeline& grayscale() { return add({OpType::Grayscale}); }
+    Pipeline& sepia() { return add({OpType::Sepia}); }
+    Pipeline& compress(float quality) { return add({OpType::Compress, quality}); }
+    Pipeline& hueRotate(float degrees) { return add({OpType::HueRotate, degrees}); }
+
+    const std::vector<Operation>& operations() const { return ops; }
+
+    // This chain with every operation put through Operation::checked(), for
+    // chains built from request parameters; throws std::invalid_argument
+    Pipeline checked() const {
+        std::vector<Operation> out;
+        out.reserve(ops.size());
+        for (const Operation& op : ops) out.push_back(Operation::checked(op));
+        return Pipeline(std::move(out));
+    }
+    bool empty() const { return ops.empty(); }
+
+    // Parses "brightness:20,contrast:1.2,gaussianblur:25:4,grayscale"
+    static Pipeline parse(const std::string& spec) {
+        Pipeline pipeline;
+        std::stringstream list(spec);
+        std::string item;
+        while (std::getline(list, item, ',')) {
+            if (item.empty()) continue;
+
+            std::stringstream fields(item);
+            std::string name, value, extra;
+            std::getline(fields, name, ':');
+            std::getline(fields, value, ':');
+            std::getline(fields, extra, ':');
+            pipeline.add(Operation::fromName(name, parseNumber(value), parseNumber(extra)));
+        }
+        return pipeline;
+    }
+
+    // Inverse of parse()
+    std::string toString() const {
+        std::ostringstream out;
+        for (size_t i = 0; i < ops.size(); i++) {
+            if (i) out << ',';
+            out << ops[i].name();
+            if (ops[i].hasValue()) out << ':' << formatValue(ops[i].value);
+            if (ops[i].extra != 0.0f) out << ':' << formatValue(ops[i].extra);
+        }
+        return out.str();
+    }
+
+    // The same chain for a copy of the image scaled by `factor`: blur kernels
+    // shrink with the image, so a preview on a proxy looks like the full result
+    Pipeline scaled(float factor) const {
+        Pipeline out(ops);
+        for (Operation& op : out.ops) {
+            if (op.type != OpType::GaussianBlur) continue;
+            op.value = std::round(op.value * factor); // Below 2 the blur is skipped
+            op.extra *= factor;
+        }
+        return out;
+    }
+
+    void execute(Image& image) const {
+        for (const Stage& stage : plan(image.getChannels())) {
+            runStage(stage, image);
+        }
+    }
+
+private:
+    // Operation applied to one row inside a fused pass; point ops carry
+    // their composed table, colour ops their composed matrix
+    struct RowOp {
+        Operation op;
+        PointOp lut;
+        ColorMatrix matrix;
+    };
+
+    // Row ops run in order on each row. With toGray the row is then reduced to
+    // channel 0 of `grayMatrix` (luminance, possibly after folded colour ops)
+    // and `afterGray` runs on the single-channel row.
+    struct RowPass {
+        std::vector<RowOp> ops;
+        bool toGray = false;
+        ColorMatrix grayMatrix = ColorMatrix::grayscale();
+        std::vector<RowOp> afterGray;
+
+        bool empty() const { return ops.empty() && !toGray; }
+        std::vector<RowOp>& tail() { return toGray ? afterGray : ops; }
+    };
+
+    struct Stage {
+        enum Kind { Rows, Blur, Edges, FlipRows, Frame } kind;
+        Operation op;  // Blur / Edges / FlipRows / Frame (whole-image ops, run on their own)
+        RowPass rows;  // The whole stage for Rows, the epilogue otherwise
+    };
+
+    std::vector<Operation> ops;
+
+    // A parse() field; empty means 0. std::stof throws out_of_range for
+    // values beyond a float, which is reported like any other bad value.
+    static float parseNumber(const std::string& field) {
+        if (field.empty()) return 0.0f;
+        try {
+            return std::stof(field);
+        } catch (const std::out_of_range&) {
+            throw std::invalid_argument("Value out of range: " + field);
+        }
+    }
+
+    // Shortest of 6 or 9 significant digits that parses back to the same float
+    static std::string formatValue(float value) {
+        std::ostringstream out;
+        out << value;
+        if (std::stof(out.str()) != value) {
+            out.str("");
+            out.precision(9);
+            out << value;
+        }
+        return out.str();
+    }
+
+    // Drops operations whose effect is discarded later in the chain
+    std::vector<Operation> simplify(int channels) const {
+        std::vector<Operation> out;
+        for (const Operation& op : ops) {
+            const bool colour = op.isColorMatrixOp() || op.type == OpType::Grayscale;
+            if (colour && channels < 3) continue; // The Image methods are no-ops there
+
+            channels = op.outputChannels(channels);
+            if ((op.type == OpType::ReflectHorizontally || op.type == OpType::ReflectVertically) &&
+                !out.empty() && out.back().type == op.type) {
+                out.pop_back();
+                continue;
+            }
+            out.push_back(op);
+        }
+        return out;
+    }
+
+    std::vector<Stage> plan(int channels) const {
+        std::vector<Stage> stages;
+        stages.push_back(Stage{Stage::Rows, {}, {}});
+
+        for (const Operation& op : simplify(channels)) {
+            RowPass& current = stages.back().rows;
+
+            switch (op.type) {
+                case OpType::GaussianBlur:
+                case OpType::EdgeDetect: {
+                    Stage::Kind kind = op.type == OpType::GaussianBlur ? Stage::Blur : Stage::Edges;
+                    stages.push_back(Stage{kind, op, {}});
+                    break;
+                }
+                case OpType::ReflectVertically:
+                    stages.push_back(Stage{Stage::FlipRows, op, {}});
+                    stages.push_back(Stage{Stage::Rows, {}, {}});
+                    break;
+                case OpType::Grayscale:
+                    if (current.toGray) {
+                        stages.push_back(Stage{Stage::Rows, {}, {}});
+                        stages.back().rows.toGray = true;
+                    } else {
+                        current.toGray = true;
+                        // Luminance of the folded colour ops, in the same pass
+                        if (!current.ops.empty() && current.ops.back().op.isColorMatrixOp() &&
+                            current.ops.back().matrix.staysInRange()) {
+                            current.grayMatrix = current.ops.back().matrix.then(current.grayMatrix);
+                            current.ops.pop_back();
+                        }
+                    }
+                    break;
+                default: {
+                    if (op.isWholeFrame()) {
+                        stages.push_back(Stage{Stage::Frame, op, {}});
+                        stages.push_back(Stage{Stage::Rows, {}, {}});
+                        break;
+                    }
+                    std::vector<RowOp>& tail = current.tail();
+                    if (op.isColorMatrixOp()) {
+                        // Fold into the preceding matrix when nothing clips in between
+                        if (!tail.empty() && tail.back().op.isColorMatrixOp() &&
+                            tail.back().matrix.staysInRange()) {
+                            tail.back().matrix = tail.back().matrix.then(op.toColorMatrix());
+                        } else {
+                            tail.push_back(RowOp{op, PointOp(), op.toColorMatrix()});
+                        }
+                    } else if (op.isPointOp()) {
+                        // Fold into the preceding table when there is one
+                        if (!tail.empty() && tail.back().op.isPointOp()) {
+                            tail.back().lut = tail.back().lut.then(op.toPointOp());
+                        } else {
+                            tail.push_back(RowOp{op, op.toPointOp(), ColorMatrix()});
+                        }
+                    } else {
+                        tail.push_back(RowOp{op, PointOp(), ColorMatrix()});
+                    }
+                    break;
+                }
+            }
+        }
+        return stages;
+    }
+
+    // Colour ops are no-ops on gray layouts, as the Image methods are
+    template <typename Layout>
+    static void runRowOps(const std::vector<RowOp>& rowOps, uint8_t* row, int y, int width, int height) {
+        for (const RowOp& r : rowOps) {
+            switch (r.op.type) {
+                case OpType::Saturation:
+                case OpType::Sepia:
+                case OpType::HueRotate:
+                    r.matrix.applyRow<Layout>(row, width);
+                    break;
+                case OpType::Vignette:
+                    vignetteRow<Layout>(row, y, width, height, r.op.value);
+                    break;
+                case OpType::ReflectHorizontally:
+                    reflectRow(row, width, Layout::channels);
+                    break;
+                default:
+                    r.lut.applyPixels<Layout>(row, width);
+                    break;
+            }
+        }
+    }
+
+    // Runs `pass` on rows [y0, y1) of `image`; gray receives the luminance
+    // rows. The pixel format is dispatched once for the band.
+    static void runRowPass(const RowPass& pass, Image& image, Image* gray, int y0, int y1) {
+        const int width = image.getWidth();
+        const int height = image.getHeight();
+        withPixelLayout(image.getPixelFormat(), [&](auto layout) {
+            using Layout = decltype(layout);
+            for (int y = y0; y < y1; y++) {
+                runRowOps<Layout>(pass.ops, image.row(y), y, width, height);
+                if (pass.toGray) {
+                    pass.grayMatrix.applyRowToGray<Layout>(image.row(y), gray->row(y), width);
+                    runRowOps<PixelLayout<PixelFormat::Gray8>>(pass.afterGray, gray->row(y), y, width, height);
+                }
+            }
+        });
+    }
+
+    static void runStage(const Stage& stage, Image& image) {
+        const int width = image.getWidth();
+        const int height = image.getHeight();
+        const size_t bytes = image.getStride() * height;
+
+        switch (stage.kind) {
+            case Stage::FlipRows:
+                image.reflectVertically();
+                return;
+
+            case Stage::Frame:
+                stage.op.applyTo(image);
+                return;
+
+            case Stage::Blur: {
+                int kernelSize = static_cast<int>(stage.op.value);
+                float sigma = stage.op.extra;
+                BlurMode mode = BlurMode::Auto;
+                if (width == 0 || height == 0 || !resolveBlur(kernelSize, sigma, mode)) break;
+
+                if (mode != BlurMode::Separable) {
+                    // The box cascade works on whole columns; its epilogue
+                    // runs as a separate row pass below
+                    image.applyGaussianBlur(kernelSize, sigma, mode);
+                    break;
+                }
+
+                GaussianKernelCache::Kernel kernel = GaussianKernelCache::get(kernelSize, sigma);
+                Image temp = Image::uninitialized(width, height, image.getPixelFormat());
+                Image gray = Image::uninitialized(stage.rows.toGray ? width : 0, height, PixelFormat::Gray8);
+                Parallel::forRows(height, bytes, [&](int y0, int y1) {
+                    gaussianBlurSeparable(image.view(), temp.view(), *kernel, y0, y1);
+                    runRowPass(stage.rows, temp, &gray, y0, y1);
+                }, 4 * kernelSize);
+                image.swap(stage.rows.toGray ? gray : temp);
+                return;
+            }
+
+            case Stage::Edges: {
+                const EdgeOptions options = stage.op.edgeOptions();
+                const bool sameChannels = stage.op.outputChannels(image.getChannels()) == image.getChannels();
+                Image temp = Image::uninitialized(width, height, sameChannels ? image.getPixelFormat() : PixelFormat::Gray8);
+                Image gray = Image::uninitialized(stage.rows.toGray ? width : 0, height, PixelFormat::Gray8);
+                Parallel::forRows(height, bytes, [&](int y0, int y1) {
+                    edgeRows(image.view(), temp.view(), options, y0, y1);
+                    runRowPass(stage.rows, temp, &gray, y0, y1);
+                });
+                image.swap(stage.rows.toGray ? gray : temp);
+                return;
+            }
+
+            case Stage::Rows:
+                break;
+        }
+
+        // Plain row pass (also the epilogue of a box blur)
+        if (stage.rows.empty()) return;
+        if (!stage.rows.toGray) {
+            Parallel::forRows(height, bytes, [&](int y0, int y1) {
+                runRowPass(stage.rows, image, nullptr, y0, y1);
+            });
+            return;
+        }
+        Image gray = Image::uninitialized(width, height, PixelFormat::Gray8);
+        Parallel::forRows(height, bytes, [&](int y0, int y1) {
+            runRowPass(stage.rows, image, &gray, y0, y1);
+        });
+        image.swap(gray);
+    }
+};
+
+#endif // PIPELINE_H
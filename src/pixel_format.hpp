@@ -0,0 +1,110 @@
+// pixel_format.hpp
+#ifndef PIXEL_FORMAT_H
+#define PIXEL_FORMAT_H
+
+#include <stdexcept>
+#include <string>
+
+
+// Which colour each interleaved byte of a pixel holds. Images decoded by
+// OpenCV are BGR(A), PPM files are RGB; the colour kernels read the order
+// from here instead of assuming one, and leave alpha untouched.
+enum class PixelFormat { Gray8, GrayAlpha8, BGR8, BGRA8, RGB8, RGBA8 };
+
+// Compile-time description of a format. Kernels are templated on it, so the
+// channel count and offsets are constants and the per-pixel loops unroll.
+// Alpha, when present, is always the last channel; the colour channels are
+// the ones before it.
+template <PixelFormat Format>
+struct PixelLayout;
+
+template <>
+struct PixelLayout<PixelFormat::Gray8> {
+    static constexpr int channels = 1, red = 0, green = 0, blue = 0, alpha = -1;
+};
+
+template <>
+struct PixelLayout<PixelFormat::GrayAlpha8> {
+    static constexpr int channels = 2, red = 0, green = 0, blue = 0, alpha = 1;
+};
+
+template <>
+struct PixelLayout<PixelFormat::BGR8> {
+    static constexpr int channels = 3, red = 2, green = 1, blue = 0, alpha = -1;
+};
+
+template <>
+struct PixelLayout<PixelFormat::BGRA8> {
+    static constexpr int channels = 4, red = 2, green = 1, blue = 0, alpha = 3;
+};
+
+template <>
+struct PixelLayout<PixelFormat::RGB8> {
+    static constexpr int channels = 3, red = 0, green = 1, blue = 2, alpha = -1;
+};
+
+template <>
+struct PixelLayout<PixelFormat::RGBA8> {
+    static constexpr int channels = 4, red = 0, green = 1, blue = 2, alpha = 3;
+};
+
+// Channels a colour or tone operation touches, and whether they are R, G, B
+template <typename Layout>
+constexpr int colourChannelsOf() { return Layout::alpha < 0 ? Layout::channels : Layout::channels - 1; }
+
+template <typename Layout>
+constexpr bool isColourLayout() { return Layout::channels >= 3; }
+
+
+inline int pixelFormatChannels(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::Gray8: return 1;
+        case PixelFormat::GrayAlpha8: return 2;
+        case PixelFormat::BGR8:
+        case PixelFormat::RGB8: return 3;
+        default: return 4;
+    }
+}
+
+inline bool hasAlpha(PixelFormat format) {
+    return format == PixelFormat::GrayAlpha8 || format == PixelFormat::BGRA8 || format == PixelFormat::RGBA8;
+}
+
+inline const char* pixelFormatName(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::Gray8: return "gray8";
+        case PixelFormat::GrayAlpha8: return "grayalpha8";
+        case PixelFormat::BGR8: return "bgr8";
+        case PixelFormat::BGRA8: return "bgra8";
+        case PixelFormat::RGB8: return "rgb8";
+        default: return "rgba8";
+    }
+}
+
+// The format a buffer of `channels` channels is taken to have when nothing
+// says otherwise: OpenCV's order, which is where most images come from
+inline PixelFormat defaultPixelFormat(int channels) {
+    switch (channels) {
+        case 1: return PixelFormat::Gray8;
+        case 2: return PixelFormat::GrayAlpha8;
+        case 3: return PixelFormat::BGR8;
+        case 4: return PixelFormat::BGRA8;
+        default: throw std::invalid_argument("Unsupported channel count: " + std::to_string(channels));
+    }
+}
+
+// Calls fn(PixelLayout<format>()) with the layout as a compile-time type, so
+// a kernel is dispatched once per call rather than per pixel
+template <typename Fn>
+decltype(auto) withPixelLayout(PixelFormat format, Fn&& fn) {
+    switch (format) {
+        case PixelFormat::Gray8: return fn(PixelLayout<PixelFormat::Gray8>());
+        case PixelFormat::GrayAlpha8: return fn(PixelLayout<PixelFormat::GrayAlpha8>());
+        case PixelFormat::BGR8: return fn(PixelLayout<PixelFormat::BGR8>());
+        case PixelFormat::BGRA8: return fn(PixelLayout<PixelFormat::BGRA8>());
+        case PixelFormat::RGB8: return fn(PixelLayout<PixelFormat::RGB8>());
+        default: return fn(PixelLayout<PixelFormat::RGBA8>());
+    }
+}
+
+#endif // PIXEL_FORMAT_H
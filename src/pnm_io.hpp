@@ -0,0 +1,141 @@
+// pnm_io.hpp
+#ifndef PNM_IO_H
+#define PNM_IO_H
+
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "image_processing.hpp"
+
+
+// Binary PGM (P5, gray) and PPM (P6, RGB) files, read and written a band of
+// rows at a time. Rows are stored back to back after a short text header, so
+// any band is one contiguous range of the file and images far larger than
+// RAM can be streamed through a small buffer.
+class PnmReader {
+public:
+    explicit PnmReader(const std::string& path) : path(path), file(path, std::ios::binary) {
+        if (!file) throw std::runtime_error("Failed to open " + path);
+
+        std::string magic = token();
+        if (magic == "P5") channels = 1;
+        else if (magic == "P6") channels = 3;
+        else throw std::invalid_argument(path + ": not a binary PGM/PPM file");
+
+        width = std::stoi(token());
+        height = std::stoi(token());
+        int maxval = std::stoi(token());
+        if (width <= 0 || height <= 0 || maxval != 255) {
+            throw std::invalid_argument(path + ": only 8-bit PGM/PPM files are supported");
+        }
+        file.get(); // The single whitespace byte before the pixels
+        dataOffset = file.tellg();
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getChannels() const { return channels; }
+    // PPM samples are stored red first
+    PixelFormat getPixelFormat() const { return channels == 1 ? PixelFormat::Gray8 : PixelFormat::RGB8; }
+
+    // Reads rows [y0, y1) into rows 0 .. y1 - y0 of `band`
+    void readRows(int y0, int y1, Image& band) {
+        const size_t rowBytes = static_cast<size_t>(width) * channels;
+        file.seekg(dataOffset + static_cast<std::streamoff>(y0 * rowBytes));
+        for (int y = y0; y < y1; y++) {
+            file.read(reinterpret_cast<char*>(band.row(y - y0)), rowBytes);
+        }
+        if (!file) throw std::runtime_error(path + ": unexpected end of file");
+    }
+
+private:
+    std::string path;
+    std::ifstream file;
+    std::streamoff dataOffset = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+
+    // Next header field, skipping whitespace and # comments
+    std::string token() {
+        std::string result;
+        int c;
+        while ((c = file.get()) != EOF) {
+            if (c == '#') {
+                while ((c = file.get()) != EOF && c != '\n') {}
+            } else if (!std::isspace(c)) {
+                result += static_cast<char>(c);
+                if (!std::isspace(file.peek()) && file.peek() != EOF) continue;
+                return result;
+            }
+        }
+        throw std::invalid_argument(path + ": truncated header");
+    }
+};
+
+
+// Appends bands of rows to a PGM/PPM file. The header is written with the
+// first band, so the channel count can be left to whatever the processing
+// produced (grayscale turns RGB into gray).
+class PnmWriter {
+public:
+    PnmWriter(const std::string& path, int width, int height)
+        : path(path), width(width), height(height) {}
+
+    // Writes `count` rows of `band`, starting at its row `first`. BGR bands
+    // are swapped to the file's RGB order on the way out.
+    void writeRows(const Image& band, int first, int count) {
+        if (!file.is_open()) open(band.getChannels());
+        if (band.getChannels() != channels || band.getWidth() != width) {
+            throw std::logic_error(path + ": band does not match the file layout");
+        }
+        const size_t rowBytes = static_cast<size_t>(width) * channels;
+        const bool swap = band.getPixelFormat() == PixelFormat::BGR8;
+        if (swap) line.resize(rowBytes);
+        for (int y = first; y < first + count; y++) {
+            const uint8_t* row = band.row(y);
+            if (swap) {
+                for (size_t i = 0; i < rowBytes; i += 3) {
+                    line[i] = row[i + 2];
+                    line[i + 1] = row[i + 1];
+                    line[i + 2] = row[i];
+                }
+                row = line.data();
+            }
+            file.write(reinterpret_cast<const char*>(row), rowBytes);
+        }
+        written += count;
+        if (!file) throw std::runtime_error("Failed to write " + path);
+    }
+
+    void close() {
+        if (written != height) throw std::logic_error(path + ": incomplete image");
+        file.close();
+        if (!file) throw std::runtime_error("Failed to write " + path);
+    }
+
+private:
+    std::string path;
+    std::ofstream file;
+    int width;
+    int height;
+    int channels = 0;
+    int written = 0;
+    std::vector<uint8_t> line; // One row in file order, for bands that need swapping
+
+    void open(int bandChannels) {
+        if (bandChannels != 1 && bandChannels != 3) {
+            throw std::invalid_argument("PGM/PPM output needs 1 or 3 channels");
+        }
+        channels = bandChannels;
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) throw std::runtime_error("Failed to create " + path);
+        file << (channels == 1 ? "P5" : "P6") << '\n' << width << ' ' << height << "\n255\n";
+    }
+};
+
+#endif // PNM_IO_H
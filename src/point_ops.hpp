@@ -0,0 +1,166 @@
+// point_ops.hpp
+#ifndef POINT_OPS_H
+#define POINT_OPS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+
+#include "pixel_format.hpp"
+#include "simd_point_ops.hpp"
+
+
+// A function of one 8-bit sample, stored as a 256-entry lookup table (one per
+// channel when the op treats channels differently). Any chain of point ops
+// composes into a single PointOp, so the chain costs one pass over the image.
+//
+//   PointOp edit = PointOp::brightness(20)
+//                      .then(PointOp::contrast(1.2f))
+//                      .then(PointOp::posterize(0.8f));
+//   image.applyLUT(edit);
+class PointOp {
+public:
+    static constexpr int kMaxChannels = 4;
+    using Table = std::array<uint8_t, 256>;
+
+    // Identity
+    PointOp() : perChannel(false) {
+        for (int v = 0; v < 256; v++) tables[0][v] = static_cast<uint8_t>(v);
+        spread();
+    }
+
+    explicit PointOp(const Table& table) : perChannel(false) {
+        tables[0] = table;
+        spread();
+    }
+
+    // The tables are filled by the same scalar row kernels the Image methods
+    // use, so a fused chain gives exactly the bytes of the separate calls.
+    static PointOp brightness(int delta) {
+        PointOp op;
+        brightnessRowScalar(op.tables[0].data(), 256, delta);
+        op.spread();
+        return op;
+    }
+
+    static PointOp contrast(float factor) {
+        PointOp op;
+        contrastRowScalar(op.tables[0].data(), 256, factor);
+        op.spread();
+        return op;
+    }
+
+    static PointOp invert() {
+        PointOp op;
+        invertRowScalar(op.tables[0].data(), 256);
+        op.spread();
+        return op;
+    }
+
+    // The colour-depth reduction done by Image::compressImage
+    static PointOp posterize(float quality) {
+        PointOp op;
+        int step = quantizeStep(quality);
+        if (step > 1) quantizeRowScalar(op.tables[0].data(), 256, step);
+        op.spread();
+        return op;
+    }
+
+    // Applies `op` to one channel only and leaves the others untouched
+    static PointOp forChannel(int channel, const PointOp& op) {
+        if (channel < 0 || channel >= kMaxChannels) {
+            throw std::out_of_range("PointOp channel out of range");
+        }
+        PointOp result;
+        result.tables[channel] = op.tables[channel];
+        result.perChannel = true;
+        return result;
+    }
+
+    // One table per channel, e.g. from the histogram corrections; channels
+    // past the end of `channelTables` are left untouched
+    static PointOp fromTables(const std::vector<Table>& channelTables) {
+        if (channelTables.size() > kMaxChannels) {
+            throw std::out_of_range("PointOp supports at most 4 channel tables");
+        }
+        PointOp result;
+        std::copy(channelTables.begin(), channelTables.end(), result.tables.begin());
+        result.perChannel = true;
+        return result;
+    }
+
+    // Quantisation step compressImage derives from `quality`
+    static int quantizeStep(float quality) {
+        quality = std::max(0.0f, std::min(1.0f, quality));
+        return static_cast<int>(256 * (1 - quality));
+    }
+
+    // This op followed by `next`
+    PointOp then(const PointOp& next) const {
+        PointOp result;
+        result.perChannel = perChannel || next.perChannel;
+        for (int c = 0; c < kMaxChannels; c++) {
+            for (int v = 0; v < 256; v++) result.tables[c][v] = next.tables[c][tables[c][v]];
+        }
+        return result;
+    }
+
+    uint8_t operator()(int channel, uint8_t value) const { return tables[channel][value]; }
+
+    const Table& table(int channel = 0) const { return tables[channel]; }
+    bool isPerChannel() const { return perChannel; }
+
+    bool isIdentity() const {
+        for (int c = 0; c < kMaxChannels; c++) {
+            for (int v = 0; v < 256; v++) {
+                if (tables[c][v] != v) return false;
+            }
+        }
+        return true;
+    }
+
+    // Maps `n` bytes in place through the shared table
+    void applyUniform(uint8_t* p, size_t n) const {
+        const uint8_t* t = tables[0].data();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            uint8_t a = t[p[i]], b = t[p[i + 1]], c = t[p[i + 2]], d = t[p[i + 3]];
+            p[i] = a; p[i + 1] = b; p[i + 2] = c; p[i + 3] = d;
+        }
+        for (; i < n; i++) p[i] = t[p[i]];
+    }
+
+    // Maps `pixels` pixels in place, channel c of each through table c. The
+    // alpha channel of the layout is never touched; without one, a uniform
+    // op maps the row as one run of bytes.
+    template <typename Layout>
+    void applyPixels(uint8_t* p, int pixels) const {
+        constexpr int channels = Layout::channels;
+        constexpr int colour = colourChannelsOf<Layout>();
+        if (!perChannel && colour == channels) {
+            applyUniform(p, static_cast<size_t>(pixels) * channels);
+            return;
+        }
+        for (int x = 0; x < pixels; x++, p += channels) {
+            for (int c = 0; c < colour; c++) p[c] = tables[c][p[c]];
+        }
+    }
+
+    void applyPixels(uint8_t* p, int pixels, PixelFormat format) const {
+        withPixelLayout(format, [&](auto layout) { applyPixels<decltype(layout)>(p, pixels); });
+    }
+
+private:
+    std::array<Table, kMaxChannels> tables;
+    bool perChannel;
+
+    // Copies table 0 to the other channels of a uniform op
+    void spread() {
+        for (int c = 1; c < kMaxChannels; c++) tables[c] = tables[0];
+    }
+};
+
+#endif // POINT_OPS_H
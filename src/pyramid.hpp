@@ -0,0 +1,51 @@
+// pyramid.hpp
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "image_processing.hpp"
+
+
+// Reduced copies of an image for previews. Each level halves the previous one
+// with a 2x2 area average, so building all of them costs about a third of one
+// pass over the original, and anything derived from a level scales with the
+// level's size instead of the camera's.
+
+// Levels of `base` halved again and again: levels[0] is half size, and the
+// last level is the first one that fits inside minWidth x minHeight (or 1x1)
+inline std::vector<Image> buildPyramid(const Image& base, int minWidth = 1, int minHeight = 1) {
+    std::vector<Image> levels;
+    const Image* current = &base;
+    while (current->getWidth() > std::max(1, minWidth) || current->getHeight() > std::max(1, minHeight)) {
+        levels.push_back(current->halfSize());
+        current = &levels.back();
+    }
+    return levels;
+}
+
+// Copy of `image` scaled to fit inside maxWidth x maxHeight, keeping its
+// aspect ratio; images that already fit are copied unchanged. Halves while
+// the result still covers the target, then finishes with one bilinear step
+// of less than 2x, so every source pixel contributes.
+inline Image fitWithin(const Image& image, int maxWidth, int maxHeight) {
+    const int width = image.getWidth(), height = image.getHeight();
+    if (width <= maxWidth && height <= maxHeight) return image;
+
+    const double scale = std::min(static_cast<double>(maxWidth) / width, static_cast<double>(maxHeight) / height);
+    const int targetWidth = std::max(1, static_cast<int>(std::lround(width * scale)));
+    const int targetHeight = std::max(1, static_cast<int>(std::lround(height * scale)));
+
+    Image level(0, 0, image.getChannels());
+    const Image* current = &image;
+    while ((current->getWidth() + 1) / 2 >= targetWidth && (current->getHeight() + 1) / 2 >= targetHeight) {
+        level = current->halfSize();
+        current = &level;
+    }
+    if (current->getWidth() == targetWidth && current->getHeight() == targetHeight) return level;
+    return current->resized(targetWidth, targetHeight);
+}
+
+#endif // PYRAMID_H
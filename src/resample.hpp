@@ -0,0 +1,75 @@
+// resample.hpp
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "image_view.hpp"
+
+
+// Row kernels for shrinking images. Image::halfSize() and Image::resized()
+// run them band by band; pyramid.hpp chains them into proxies.
+
+// Rows [y0, y1) of dst = src halved in both directions, each pixel the
+// rounded mean of a 2x2 block. An odd last row or column averages with itself.
+inline void halveRows(ConstImageView src, ImageView dst, int y0, int y1) {
+    const int channels = src.channels;
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* a = src.row(2 * y);
+        const uint8_t* b = src.row(std::min(2 * y + 1, src.height - 1));
+        uint8_t* out = dst.row(y);
+        for (int x = 0; x < dst.width; x++) {
+            const int left = 2 * x * channels;
+            const int right = std::min(2 * x + 1, src.width - 1) * channels;
+            for (int c = 0; c < channels; c++) {
+                out[x * channels + c] = static_cast<uint8_t>(
+                    (a[left + c] + a[right + c] + b[left + c] + b[right + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+
+// Source position and 8-bit fraction for each destination column or row,
+// sampling at pixel centres
+struct BilinearTaps {
+    std::vector<int> index; // First of the two source samples
+    std::vector<int> weight; // Weight of the second sample, 0..256
+
+    BilinearTaps(int srcSize, int dstSize) : index(dstSize), weight(dstSize) {
+        const double scale = static_cast<double>(srcSize) / dstSize;
+        for (int i = 0; i < dstSize; i++) {
+            double pos = std::max(0.0, (i + 0.5) * scale - 0.5);
+            int first = std::min(static_cast<int>(pos), srcSize - 1);
+            index[i] = first;
+            weight[i] = first + 1 < srcSize ? static_cast<int>((pos - first) * 256 + 0.5) : 0;
+        }
+    }
+};
+
+// Rows [y0, y1) of dst bilinearly resampled from src. Meant for factors up
+// to 2; larger reductions should halve first, or the result aliases.
+inline void resizeBilinearRows(ConstImageView src, ImageView dst, const BilinearTaps& xs,
+                               const BilinearTaps& ys, int y0, int y1) {
+    const int channels = src.channels;
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* top = src.row(ys.index[y]);
+        const uint8_t* bottom = src.row(std::min(ys.index[y] + 1, src.height - 1));
+        const int wy = ys.weight[y];
+        uint8_t* out = dst.row(y);
+        for (int x = 0; x < dst.width; x++) {
+            const int left = xs.index[x] * channels;
+            const int right = std::min(xs.index[x] + 1, src.width - 1) * channels;
+            const int wx = xs.weight[x];
+            for (int c = 0; c < channels; c++) {
+                int upper = top[left + c] * (256 - wx) + top[right + c] * wx;
+                int lower = bottom[left + c] * (256 - wx) + bottom[right + c] * wx;
+                out[x * channels + c] = static_cast<uint8_t>((upper * (256 - wy) + lower * wy + (1 << 15)) >> 16);
+            }
+        }
+    }
+}
+
+#endif // RESAMPLE_H
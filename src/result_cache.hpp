@@ -0,0 +1,176 @@
+// result_cache.hpp
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "image_processing.hpp"
+
+
+// 128-bit keyed hash of a byte range, as 32 hex digits. The key is drawn at
+// startup, so clients cannot precompute colliding inputs to poison the cache.
+// Not a cryptographic hash; only meant to name content inside one process.
+inline std::string contentHash(const void* data, size_t size) {
+    static const uint64_t seed = [] {
+        std::random_device random;
+        return (uint64_t(random()) << 32) | random();
+    }();
+
+    auto mix = [](uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    };
+
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t a = seed ^ 0x9e3779b97f4a7c15ULL ^ size;
+    uint64_t b = mix(seed + 0x632be59bd9b4e019ULL) ^ size;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint64_t x, y;
+        std::memcpy(&x, p + i, 8);
+        std::memcpy(&y, p + i + 8, 8);
+        a = mix(a ^ x) + b;
+        b = mix(b ^ y) + a;
+    }
+    uint8_t tail[16] = {};
+    if (size > i) std::memcpy(tail, p + i, size - i);
+    uint64_t x, y;
+    std::memcpy(&x, tail, 8);
+    std::memcpy(&y, tail + 8, 8);
+    a = mix(a ^ x ^ (size - i));
+    b = mix(b ^ y) + a;
+
+    char text[33];
+    std::snprintf(text, sizeof(text), "%016llx%016llx",
+                  static_cast<unsigned long long>(a), static_cast<unsigned long long>(b));
+    return text;
+}
+
+inline std::string contentHash(const std::string& bytes) {
+    return contentHash(bytes.data(), bytes.size());
+}
+
+
+// Size-bounded LRU map from content keys to immutable results. Values are
+// handed out as shared_ptr<const Value>, so a hit costs one lock and a
+// refcount bump, and eviction never invalidates a result still being sent.
+// `SizeOf` gives the bytes a value is charged for.
+template <typename Value, typename SizeOf>
+class ResultCache {
+public:
+    using Pointer = std::shared_ptr<const Value>;
+
+    explicit ResultCache(size_t budgetBytes, SizeOf sizeOf = SizeOf())
+        : budget(budgetBytes), sizeOf(sizeOf) {}
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Null on a miss
+    Pointer find(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->value;
+    }
+
+    // Stores `value` unless it alone exceeds the budget; returns what is now
+    // cached under `key`
+    Pointer insert(const std::string& key, Pointer value) {
+        const size_t bytes = sizeOf(*value);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) return it->second->value;
+        if (bytes > budget) return value;
+
+        lru.push_front({key, value, bytes});
+        index.emplace(key, lru.begin());
+        totalBytes += bytes;
+        while (totalBytes > budget) {
+            totalBytes -= lru.back().bytes;
+            index.erase(lru.back().key);
+            lru.pop_back();
+        }
+        return value;
+    }
+
+    bool enabled() const { return budget > 0; }
+    size_t budgetBytes() const { return budget; }
+
+    size_t bytesInUse() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totalBytes;
+    }
+
+    uint64_t hitCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits;
+    }
+
+    uint64_t missCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return misses;
+    }
+
+private:
+    struct Node {
+        std::string key;
+        Pointer value;
+        size_t bytes;
+    };
+
+    const size_t budget;
+    SizeOf sizeOf;
+    mutable std::mutex mutex;
+    std::list<Node> lru; // Most recently used first
+    std::unordered_map<std::string, typename std::list<Node>::iterator> index;
+    size_t totalBytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+
+struct EncodedBytes {
+    size_t operator()(const std::string& bytes) const { return bytes.size(); }
+};
+
+struct PixelBytes {
+    size_t operator()(const Image& image) const {
+        return image.getStride() * static_cast<size_t>(image.getHeight());
+    }
+};
+
+// Encoded outputs (JPEG, PNG, ...) by content key and format
+using EncodedCache = ResultCache<std::string, EncodedBytes>;
+// Decoded images by content key, so a repeated edit is a copy instead of a recompute
+using PixelCache = ResultCache<Image, PixelBytes>;
+
+// Cache budget from the environment variable `name`, in MiB
+inline size_t cacheBudgetFromEnvironment(const char* name, size_t defaultMegabytes) {
+    if (const char* mb = std::getenv(name)) {
+        long value = std::atol(mb);
+        if (value >= 0) return static_cast<size_t>(value) << 20;
+    }
+    return defaultMegabytes << 20;
+}
+
+#endif // RESULT_CACHE_H
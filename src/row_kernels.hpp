@@ -0,0 +1,56 @@
+// row_kernels.hpp
+#ifndef ROW_KERNELS_H
+#define ROW_KERNELS_H
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "pixel_format.hpp"
+
+
+// Per-row bodies of the Image operations that only look at one pixel (or one
+// row) at a time. Image runs them band by band; the pipeline executor chains
+// several of them on the same row while it is still in cache. The colour
+// operations are ColorMatrix rows (see color_matrix.hpp).
+
+// Row `y` of a frame that is frameWidth x frameHeight pixels; alpha is kept
+template <typename Layout>
+void vignetteRow(uint8_t* p, int y, int frameWidth, int frameHeight, float strength) {
+    constexpr int channels = Layout::channels;
+    float centerX = frameWidth / 2.0f;
+    float centerY = frameHeight / 2.0f;
+    float maxDist = std::sqrt(centerX * centerX + centerY * centerY);
+
+    for (int x = 0; x < frameWidth; x++, p += channels) {
+        float distFromCenter = std::sqrt(
+            std::pow(x - centerX, 2) +
+            std::pow(y - centerY, 2)
+        );
+
+        float vignetteMultiplier = 1.0f - (distFromCenter / maxDist) * strength;
+        vignetteMultiplier = std::max(0.0f, vignetteMultiplier);
+
+        for (int c = 0; c < colourChannelsOf<Layout>(); c++) {
+            p[c] = std::clamp(
+                static_cast<int>(p[c] * vignetteMultiplier),
+                0, 255
+            );
+        }
+    }
+}
+
+inline void vignetteRow(uint8_t* p, int y, int frameWidth, int frameHeight, PixelFormat format, float strength) {
+    withPixelLayout(format, [&](auto layout) {
+        vignetteRow<decltype(layout)>(p, y, frameWidth, frameHeight, strength);
+    });
+}
+
+inline void reflectRow(uint8_t* p, int width, int channels) {
+    for (int x = 0; x < width / 2; x++) {
+        std::swap_ranges(p + x * channels, p + (x + 1) * channels,
+                         p + (width - 1 - x) * channels);
+    }
+}
+
+#endif // ROW_KERNELS_H
@@ -0,0 +1,237 @@
+// session_store.hpp
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "image_processing.hpp"
+#include "pipeline.hpp"
+
+
+// Screen-sized stand-in for a stored image. Edits are tried on `proxy` and
+// only recorded in `pending`, which is replayed on the full image on commit.
+struct Preview {
+    Image proxy = Image(0, 0);
+    std::string sourceKey; // contentKey of the image the proxy was made from
+    int maxWidth = 0;
+    int maxHeight = 0;
+    Pipeline pending;
+};
+
+// One stored image. `contentKey` names its current pixels: the hash of the
+// uploaded bytes, re-hashed with every operation applied since, so equal
+// uploads edited the same way share a key (see result_cache.hpp).
+struct Session {
+    Image image;
+    std::string contentKey;
+    Preview preview;
+};
+
+
+// Decoded images kept in RAM between requests, one per upload, keyed by a
+// random ID. The store lock only guards the index and is never held while
+// pixels are touched; each entry has its own mutex, so edits to different
+// images run in parallel and edits to one image are serialised. Readers that
+// only need the current pixels take a snapshot() instead, which never waits
+// for an edit in progress.
+//
+// Least recently used images are dropped once the total pixel bytes exceed
+// the budget. An entry that is evicted while a request is still working on it
+// stays alive until that request finishes.
+class SessionStore {
+public:
+    static constexpr size_t kDefaultBudgetBytes = size_t(512) << 20;
+
+    explicit SessionStore(size_t budgetBytes = budgetFromEnvironment())
+        : budget(budgetBytes) {}
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    // Stores `image` under a new ID and returns the ID
+    std::string put(Image image, std::string contentKey = std::string()) {
+        auto entry = std::make_shared<Entry>(Session{std::move(image), std::move(contentKey)});
+        std::lock_guard<std::mutex> lock(indexMutex);
+        std::string id = newId();
+        lru.push_front(id);
+        index.emplace(id, Slot{entry, lru.begin(), entry->bytes});
+        totalBytes += entry->bytes;
+        evict();
+        return id;
+    }
+
+    // Image and content key as of the last completed put() or with()
+    struct Snapshot {
+        std::shared_ptr<const Image> image; // Null when the ID is unknown
+        std::string contentKey;
+    };
+
+    // Runs fn(Session&) with the entry locked and marks it most recently used.
+    // Returns false when the ID is unknown or has been evicted.
+    //
+    // fn must replace session.image rather than edit its pixels in place:
+    // snapshots share its buffer.
+    template <typename Fn>
+    bool with(const std::string& id, Fn&& fn) {
+        std::shared_ptr<Entry> entry = acquire(id);
+        if (!entry) return false;
+
+        size_t bytes;
+        {
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            fn(entry->session);
+            bytes = entry->bytes = sessionBytes(entry->session);
+            entry->publish();
+        }
+
+        // Operations like grayscale, and previews, change the footprint
+        std::lock_guard<std::mutex> lock(indexMutex);
+        auto it = index.find(id);
+        if (it != index.end() && it->second.entry == entry) {
+            totalBytes = totalBytes - it->second.bytes + bytes;
+            it->second.bytes = bytes;
+            evict();
+        }
+        return true;
+    }
+
+    // The current image of `id` and marks it most recently used. Only waits
+    // for the moment a finished edit takes to publish its result, never for
+    // the edit itself.
+    Snapshot snapshot(const std::string& id) {
+        std::shared_ptr<Entry> entry = acquire(id);
+        if (!entry) return Snapshot();
+        std::lock_guard<std::mutex> lock(entry->snapshotMutex);
+        return entry->published;
+    }
+
+    bool contains(const std::string& id) const {
+        std::lock_guard<std::mutex> lock(indexMutex);
+        return index.count(id) != 0;
+    }
+
+    bool erase(const std::string& id) {
+        std::lock_guard<std::mutex> lock(indexMutex);
+        auto it = index.find(id);
+        if (it == index.end()) return false;
+        remove(it);
+        return true;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(indexMutex);
+        return index.size();
+    }
+
+    size_t bytesInUse() const {
+        std::lock_guard<std::mutex> lock(indexMutex);
+        return totalBytes;
+    }
+
+    size_t budgetBytes() const { return budget; }
+
+    // IMAGE_STORE_MB overrides the default 512 MiB budget
+    static size_t budgetFromEnvironment() {
+        if (const char* mb = std::getenv("IMAGE_STORE_MB")) {
+            long value = std::atol(mb);
+            if (value > 0) return static_cast<size_t>(value) << 20;
+        }
+        return kDefaultBudgetBytes;
+    }
+
+private:
+    struct Entry {
+        explicit Entry(Session s) : session(std::move(s)), bytes(sessionBytes(session)) { publish(); }
+
+        std::mutex mutex;
+        Session session;
+        size_t bytes; // Guarded by `mutex`
+
+        std::mutex snapshotMutex; // Held only to copy `published`
+        Snapshot published;
+
+        // Called with `mutex` held. The snapshot is a view onto the
+        // session's buffer, not a copy; an edit swaps in a new buffer, so the
+        // pixels behind a snapshot never change.
+        void publish() {
+            if (published.image && published.contentKey == session.contentKey &&
+                published.image->view().data == session.image.view().data) {
+                return;
+            }
+            Image& image = session.image;
+            Snapshot next{std::make_shared<const Image>(image.crop(0, 0, image.getWidth(), image.getHeight())),
+                          session.contentKey};
+            std::lock_guard<std::mutex> lock(snapshotMutex);
+            published = std::move(next);
+        }
+    };
+
+    struct Slot {
+        std::shared_ptr<Entry> entry;
+        std::list<std::string>::iterator position;
+        size_t bytes; // What the entry counts for in totalBytes
+    };
+
+    using Index = std::unordered_map<std::string, Slot>;
+
+    const size_t budget;
+    mutable std::mutex indexMutex;
+    Index index;
+    std::list<std::string> lru; // Most recently used first
+    size_t totalBytes = 0;
+    std::random_device random;
+
+    static size_t imageBytes(const Image& image) {
+        return image.getStride() * static_cast<size_t>(image.getHeight());
+    }
+
+    static size_t sessionBytes(const Session& session) {
+        return imageBytes(session.image) + imageBytes(session.preview.proxy);
+    }
+
+    std::shared_ptr<Entry> acquire(const std::string& id) {
+        std::lock_guard<std::mutex> lock(indexMutex);
+        auto it = index.find(id);
+        if (it == index.end()) return nullptr;
+        lru.splice(lru.begin(), lru, it->second.position);
+        return it->second.entry;
+    }
+
+    // Drops least recently used entries until the budget holds. The most
+    // recent entry is always kept, even if it alone is over budget.
+    void evict() {
+        while (totalBytes > budget && index.size() > 1) {
+            remove(index.find(lru.back()));
+        }
+    }
+
+    void remove(Index::iterator it) {
+        totalBytes -= it->second.bytes;
+        lru.erase(it->second.position);
+        index.erase(it);
+    }
+
+    // 128 random bits as hex; unguessable, so one client cannot address
+    // another client's image
+    std::string newId() {
+        std::string id;
+        do {
+            char text[33];
+            std::snprintf(text, sizeof(text), "%08x%08x%08x%08x",
+                          random(), random(), random(), random());
+            id = text;
+        } while (index.count(id));
+        return id;
+    }
+};
+
+#endif // SESSION_STORE_H
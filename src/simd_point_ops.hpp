@@ -0,0 +1,409 @@
+// simd_point_ops.hpp
+#ifndef SIMD_POINT_OPS_H
+#define SIMD_POINT_OPS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMAGE_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define IMAGE_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+// Row kernels for the per-byte point operations. Every vector version gives
+// the same bytes as the scalar one: brightness/invert/quantize are exact
+// integer arithmetic, and contrast does the scalar float steps in the same
+// order (separate multiply and add, no FMA), then truncates. The products go
+// through unfused(), so no -ffp-contract setting or -march can change that;
+// tests/simd_point_ops_test.cpp checks every level against the scalar code.
+//
+// The instruction set is picked once at runtime, so a single binary runs on
+// any x86-64 machine. IMAGE_SIMD=scalar|sse2|avx2|avx512 caps the level.
+
+enum class SimdLevel { Scalar, SSE2, AVX2, AVX512, NEON };
+
+struct PointKernels {
+    SimdLevel level;
+    const char* name;
+    void (*brightness)(uint8_t* p, size_t n, int delta);
+    void (*contrast)(uint8_t* p, size_t n, float factor);
+    void (*invert)(uint8_t* p, size_t n);
+    void (*quantize)(uint8_t* p, size_t n, int step); // (v / step) * step, step >= 2
+};
+
+
+// Scalar reference
+inline void brightnessRowScalar(uint8_t* p, size_t n, int delta) {
+    for (size_t i = 0; i < n; i++) {
+        p[i] = static_cast<uint8_t>(std::clamp(static_cast<int>(p[i]) + delta, 0, 255));
+    }
+}
+
+// Makes a product opaque to the optimiser, so it cannot be fused with the add
+// that follows: on FMA targets (-march=native) GCC contracts a mul/add pair by
+// default, intrinsics included, and the rounding would then differ by level
+inline float unfused(float v) {
+#if defined(__SSE2__)
+    __asm__("" : "+x"(v));
+#elif defined(__aarch64__)
+    __asm__("" : "+w"(v));
+#else
+    volatile float opaque = v;
+    v = opaque;
+#endif
+    return v;
+}
+
+inline void contrastRowScalar(uint8_t* p, size_t n, float factor) {
+    for (size_t i = 0; i < n; i++) {
+        float pixel = p[i];
+        float adjusted = 128 + unfused((pixel - 128) * factor);
+        p[i] = static_cast<uint8_t>(std::clamp(adjusted, 0.0f, 255.0f));
+    }
+}
+
+inline void invertRowScalar(uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) p[i] = 255 - p[i];
+}
+
+inline void quantizeRowScalar(uint8_t* p, size_t n, int step) {
+    for (size_t i = 0; i < n; i++) p[i] = (p[i] / step) * step;
+}
+
+// v / step == (v * quantizeMagic(step)) >> 16 for every 8-bit v and
+// 2 <= step <= 256, so vector code can divide with a 16-bit multiply-high
+inline uint16_t quantizeMagic(int step) {
+    return static_cast<uint16_t>((65536 + step - 1) / step);
+}
+
+
+#if IMAGE_SIMD_X86
+
+__attribute__((target("sse2")))
+inline __m128 unfused(__m128 v) {
+    __asm__("" : "+x"(v));
+    return v;
+}
+
+__attribute__((target("avx2")))
+inline __m256 unfused(__m256 v) {
+    __asm__("" : "+x"(v));
+    return v;
+}
+
+__attribute__((target("sse2")))
+inline void brightnessRowSSE2(uint8_t* p, size_t n, int delta) {
+    delta = std::clamp(delta, -255, 255);
+    const __m128i amount = _mm_set1_epi8(static_cast<char>(std::abs(delta)));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i*>(p + i));
+        v = delta >= 0 ? _mm_adds_epu8(v, amount) : _mm_subs_epu8(v, amount);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), v);
+    }
+    brightnessRowScalar(p + i, n - i, delta);
+}
+
+__attribute__((target("sse2")))
+inline __m128i contrastLanesSSE2(__m128i v32, __m128 f) {
+    const __m128 mid = _mm_set1_ps(128.0f);
+    __m128 x = _mm_cvtepi32_ps(v32);
+    x = _mm_add_ps(mid, unfused(_mm_mul_ps(_mm_sub_ps(x, mid), f)));
+    x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(255.0f)), _mm_setzero_ps());
+    return _mm_cvttps_epi32(x);
+}
+
+__attribute__((target("sse2")))
+inline void contrastRowSSE2(uint8_t* p, size_t n, float factor) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 f = _mm_set1_ps(factor);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i*>(p + i));
+        __m128i v16lo = _mm_unpacklo_epi8(v, zero);
+        __m128i v16hi = _mm_unpackhi_epi8(v, zero);
+        __m128i a = _mm_packs_epi32(contrastLanesSSE2(_mm_unpacklo_epi16(v16lo, zero), f),
+                                    contrastLanesSSE2(_mm_unpackhi_epi16(v16lo, zero), f));
+        __m128i b = _mm_packs_epi32(contrastLanesSSE2(_mm_unpacklo_epi16(v16hi, zero), f),
+                                    contrastLanesSSE2(_mm_unpackhi_epi16(v16hi, zero), f));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_packus_epi16(a, b));
+    }
+    contrastRowScalar(p + i, n - i, factor);
+}
+
+__attribute__((target("sse2")))
+inline void invertRowSSE2(uint8_t* p, size_t n) {
+    const __m128i ones = _mm_set1_epi8(static_cast<char>(0xFF));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i*>(p + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_xor_si128(v, ones));
+    }
+    invertRowScalar(p + i, n - i);
+}
+
+__attribute__((target("sse2")))
+inline void quantizeRowSSE2(uint8_t* p, size_t n, int step) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i magic = _mm_set1_epi16(static_cast<short>(quantizeMagic(step)));
+    const __m128i s = _mm_set1_epi16(static_cast<short>(step));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i*>(p + i));
+        __m128i a = _mm_mullo_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(v, zero), magic), s);
+        __m128i b = _mm_mullo_epi16(_mm_mulhi_epu16(_mm_unpackhi_epi8(v, zero), magic), s);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_packus_epi16(a, b));
+    }
+    quantizeRowScalar(p + i, n - i, step);
+}
+
+
+__attribute__((target("avx2")))
+inline void brightnessRowAVX2(uint8_t* p, size_t n, int delta) {
+    delta = std::clamp(delta, -255, 255);
+    const __m256i amount = _mm256_set1_epi8(static_cast<char>(std::abs(delta)));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i*>(p + i));
+        v = delta >= 0 ? _mm256_adds_epu8(v, amount) : _mm256_subs_epu8(v, amount);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), v);
+    }
+    brightnessRowSSE2(p + i, n - i, delta);
+}
+
+__attribute__((target("avx2")))
+inline __m256i contrastLanesAVX2(__m128i v8, __m256 f) {
+    const __m256 mid = _mm256_set1_ps(128.0f);
+    __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v8));
+    x = _mm256_add_ps(mid, unfused(_mm256_mul_ps(_mm256_sub_ps(x, mid), f)));
+    x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(255.0f)), _mm256_setzero_ps());
+    return _mm256_cvttps_epi32(x);
+}
+
+__attribute__((target("avx2")))
+inline void contrastRowAVX2(uint8_t* p, size_t n, float factor) {
+    const __m256 f = _mm256_set1_ps(factor);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i*>(p + i));
+        // packus works per 128-bit lane; the permute restores element order
+        __m256i packed = _mm256_packus_epi32(contrastLanesAVX2(v, f),
+                                             contrastLanesAVX2(_mm_srli_si128(v, 8), f));
+        packed = _mm256_permute4x64_epi64(packed, 0xD8);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(packed),
+                                         _mm256_extracti128_si256(packed, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), bytes);
+    }
+    contrastRowScalar(p + i, n - i, factor);
+}
+
+__attribute__((target("avx2")))
+inline void invertRowAVX2(uint8_t* p, size_t n) {
+    const __m256i ones = _mm256_set1_epi8(static_cast<char>(0xFF));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i*>(p + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_xor_si256(v, ones));
+    }
+    invertRowSSE2(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline void quantizeRowAVX2(uint8_t* p, size_t n, int step) {
+    const __m256i magic = _mm256_set1_epi16(static_cast<short>(quantizeMagic(step)));
+    const __m256i s = _mm256_set1_epi16(static_cast<short>(step));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i*>(p + i)));
+        v = _mm256_mullo_epi16(_mm256_mulhi_epu16(v, magic), s);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), bytes);
+    }
+    quantizeRowScalar(p + i, n - i, step);
+}
+
+
+// GCC 12's AVX-512 headers trip -Wmaybe-uninitialized on their own
+// _mm512_undefined_* placeholders
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx512f,avx512bw")))
+inline void brightnessRowAVX512(uint8_t* p, size_t n, int delta) {
+    delta = std::clamp(delta, -255, 255);
+    const __m512i amount = _mm512_set1_epi8(static_cast<char>(std::abs(delta)));
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512(p + i);
+        v = delta >= 0 ? _mm512_adds_epu8(v, amount) : _mm512_subs_epu8(v, amount);
+        _mm512_storeu_si512(p + i, v);
+    }
+    brightnessRowAVX2(p + i, n - i, delta);
+}
+
+// AVX-512F implies FMA, and GCC would fuse a plain mul/add pair; the explicit
+// round-to-nearest forms keep the two roundings of the scalar code.
+__attribute__((target("avx512f,avx512bw")))
+inline __m128i contrastLanesAVX512(__m128i v8, __m512 f) {
+    const __m512 mid = _mm512_set1_ps(128.0f);
+    const int rounding = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+    __m512 x = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(v8));
+    x = _mm512_mul_round_ps(_mm512_sub_ps(x, mid), f, rounding);
+    x = _mm512_add_round_ps(mid, x, rounding);
+    x = _mm512_max_ps(_mm512_min_ps(x, _mm512_set1_ps(255.0f)), _mm512_setzero_ps());
+    return _mm512_cvtusepi32_epi8(_mm512_cvttps_epi32(x));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline void contrastRowAVX512(uint8_t* p, size_t n, float factor) {
+    const __m512 f = _mm512_set1_ps(factor);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i*>(p + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), contrastLanesAVX512(v, f));
+    }
+    // The tail goes through a padded block, one more vector step
+    if (i < n) {
+        alignas(16) uint8_t block[16] = {};
+        std::memcpy(block, p + i, n - i);
+        __m128i v = _mm_load_si128(reinterpret_cast<__m128i*>(block));
+        _mm_store_si128(reinterpret_cast<__m128i*>(block), contrastLanesAVX512(v, f));
+        std::memcpy(p + i, block, n - i);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline void invertRowAVX512(uint8_t* p, size_t n) {
+    const __m512i ones = _mm512_set1_epi8(static_cast<char>(0xFF));
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512(p + i);
+        _mm512_storeu_si512(p + i, _mm512_xor_si512(v, ones));
+    }
+    invertRowAVX2(p + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline void quantizeRowAVX512(uint8_t* p, size_t n, int step) {
+    const __m512i magic = _mm512_set1_epi16(static_cast<short>(quantizeMagic(step)));
+    const __m512i s = _mm512_set1_epi16(static_cast<short>(step));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512i v = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<__m256i*>(p + i)));
+        v = _mm512_mullo_epi16(_mm512_mulhi_epu16(v, magic), s);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm512_cvtepi16_epi8(v));
+    }
+    quantizeRowAVX2(p + i, n - i, step);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // IMAGE_SIMD_X86
+
+
+#if IMAGE_SIMD_NEON
+
+// NEON is baseline on AArch64, so there is nothing to detect. Contrast stays
+// on the scalar kernel here.
+inline void brightnessRowNEON(uint8_t* p, size_t n, int delta) {
+    delta = std::clamp(delta, -255, 255);
+    const uint8x16_t amount = vdupq_n_u8(static_cast<uint8_t>(std::abs(delta)));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        vst1q_u8(p + i, delta >= 0 ? vqaddq_u8(v, amount) : vqsubq_u8(v, amount));
+    }
+    brightnessRowScalar(p + i, n - i, delta);
+}
+
+inline void invertRowNEON(uint8_t* p, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) vst1q_u8(p + i, vmvnq_u8(vld1q_u8(p + i)));
+    invertRowScalar(p + i, n - i);
+}
+
+inline void quantizeRowNEON(uint8_t* p, size_t n, int step) {
+    const uint16x8_t s = vdupq_n_u16(static_cast<uint16_t>(step));
+    const uint16_t magic = quantizeMagic(step);
+    auto quantize = [&](uint16x8_t v) {
+        uint32x4_t lo = vmull_n_u16(vget_low_u16(v), magic);
+        uint32x4_t hi = vmull_n_u16(vget_high_u16(v), magic);
+        uint16x8_t q = vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+        return vmovn_u16(vmulq_u16(q, s));
+    };
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        vst1q_u8(p + i, vcombine_u8(quantize(vmovl_u8(vget_low_u8(v))),
+                                    quantize(vmovl_u8(vget_high_u8(v)))));
+    }
+    quantizeRowScalar(p + i, n - i, step);
+}
+
+#endif // IMAGE_SIMD_NEON
+
+
+// Best level this CPU supports
+inline SimdLevel detectSimdLevel() {
+#if IMAGE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+#elif IMAGE_SIMD_NEON
+    return SimdLevel::NEON;
+#endif
+    return SimdLevel::Scalar;
+}
+
+// Kernel table for `level`. Levels the build or CPU cannot run fall back to
+// the best one below them.
+inline PointKernels pointKernelsFor(SimdLevel level) {
+    const SimdLevel best = detectSimdLevel();
+    if (best == SimdLevel::NEON && level != SimdLevel::Scalar) level = SimdLevel::NEON;
+    if (best != SimdLevel::NEON && level > best) level = best;
+
+    switch (level) {
+#if IMAGE_SIMD_X86
+        case SimdLevel::AVX512:
+            return {level, "avx512", brightnessRowAVX512, contrastRowAVX512, invertRowAVX512, quantizeRowAVX512};
+        case SimdLevel::AVX2:
+            return {level, "avx2", brightnessRowAVX2, contrastRowAVX2, invertRowAVX2, quantizeRowAVX2};
+        case SimdLevel::SSE2:
+            return {level, "sse2", brightnessRowSSE2, contrastRowSSE2, invertRowSSE2, quantizeRowSSE2};
+#endif
+#if IMAGE_SIMD_NEON
+        case SimdLevel::NEON:
+            return {level, "neon", brightnessRowNEON, contrastRowScalar, invertRowNEON, quantizeRowNEON};
+#endif
+        default:
+            return {SimdLevel::Scalar, "scalar", brightnessRowScalar, contrastRowScalar, invertRowScalar, quantizeRowScalar};
+    }
+}
+
+// Kernels used by Image, chosen on first use
+inline const PointKernels& pointKernels() {
+    static const PointKernels kernels = [] {
+        SimdLevel level = detectSimdLevel();
+        if (const char* cap = std::getenv("IMAGE_SIMD")) {
+            if (std::strcmp(cap, "scalar") == 0) level = SimdLevel::Scalar;
+            else if (std::strcmp(cap, "sse2") == 0) level = std::min(level, SimdLevel::SSE2);
+            else if (std::strcmp(cap, "avx2") == 0) level = std::min(level, SimdLevel::AVX2);
+        }
+        return pointKernelsFor(level);
+    }();
+    return kernels;
+}
+
+#endif // SIMD_POINT_OPS_H
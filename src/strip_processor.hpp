@@ -0,0 +1,260 @@
+// strip_processor.hpp
+#ifndef STRIP_PROCESSOR_H
+#define STRIP_PROCESSOR_H
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "buffer_pool.hpp"
+#include "image_processing.hpp"
+#include "pipeline.hpp"
+#include "pnm_io.hpp"
+#include "thread_pool.hpp"
+
+
+// Out-of-core execution of a Pipeline on PGM/PPM files that do not fit in
+// memory. The frame is processed in full-width strips; each strip is read
+// with enough halo rows above and below that the blurs and edge detection
+// see the same neighbourhood as on the whole frame, and only its interior is
+// written out. Results are byte-identical to running the pipeline on the
+// whole image.
+//
+// A vertical flip reorders rows across the whole frame, so it ends a pass:
+// the next pass reads its strips from the mirrored position of an
+// intermediate file.
+//
+// The memory limit covers the strip buffers, the rows each worker thread
+// keeps for blurs and edge detection, and the reader and writer lines. To
+// stay under it, run() lowers the shared thread count where the per-thread
+// rows would not fit and keeps no free buffers in the shared BufferPool;
+// both are restored when it returns. The program itself comes on top.
+struct StripOptions {
+    size_t memoryLimit = size_t(256) << 20; // Bytes for strip buffers and per-thread scratch
+};
+
+struct StripReport {
+    int passes = 0;
+    int strips = 0;
+    int stripRows = 0; // Rows written per strip in the last pass
+    int threads = 0;   // Worker threads in the last pass
+};
+
+class StripProcessor {
+public:
+    // A strip, the copy blur/Sobel write into and the grayscale plane of a
+    // fused epilogue are alive at once
+    static constexpr int kBufferCopies = 3;
+
+    StripProcessor(Pipeline pipeline, StripOptions options = {})
+        : passes(split(pipeline)), options(options) {}
+
+    StripReport run(const std::string& inputPath, const std::string& outputPath) const {
+        // Freed strips would otherwise stay pooled on top of the limit
+        PoolCapacityGuard noPooling(0);
+#ifdef __GLIBC__
+        // glibc raises its mmap threshold to the largest block freed so far,
+        // after which strip-sized blocks come from the heap and are kept
+        // there as it fragments. A fixed threshold returns them on free; it
+        // cannot be read back, so it stays set after run()
+        mallopt(M_MMAP_THRESHOLD, 128 << 10);
+#endif
+        ParallelConfigGuard restoreThreads;
+        const int maxThreads = Parallel::pool()->size();
+        StripReport report;
+        std::string source = inputPath;
+        for (size_t i = 0; i < passes.size(); i++) {
+            const bool last = i + 1 == passes.size();
+            const std::string target = last ? outputPath : outputPath + ".pass" + std::to_string(i);
+            try {
+                runPass(passes[i], source, target, maxThreads, report);
+            } catch (...) {
+                if (!last) std::remove(target.c_str());
+                if (source != inputPath) std::remove(source.c_str());
+                throw;
+            }
+            if (source != inputPath) std::remove(source.c_str());
+            source = target;
+        }
+        return report;
+    }
+
+    // Rows a strip must read beyond the rows it writes, on each side
+    static int haloRows(const Operation& op) {
+        if (op.isWholeFrame()) {
+            // Canny's hysteresis and the histogram-based ops see the whole frame; no halo is enough
+            throw std::invalid_argument(op.name() + " needs the whole image and cannot run in strips");
+        }
+        if (op.type == OpType::EdgeDetect) return 1;
+        if (op.type != OpType::GaussianBlur) return 0;
+
+        int kernelSize = static_cast<int>(op.value);
+        float sigma = op.extra;
+        BlurMode mode = BlurMode::Auto;
+        if (!resolveBlur(kernelSize, sigma, mode)) return 0;
+        if (mode == BlurMode::Separable) return kernelSize / 2;
+
+        int halo = 0;
+        for (int box : boxesForGauss(sigma)) halo += box / 2;
+        return halo;
+    }
+
+    // Bytes one worker thread allocates while running `op` on rows of the
+    // given shape, beyond the image buffers themselves
+    static size_t threadScratchBytes(const Operation& op, int width, int channels) {
+        const size_t rowLen = static_cast<size_t>(width) * channels;
+        if (op.type == OpType::EdgeDetect) {
+            // GradientRows' smoothed, differenced and gray rows, then
+            // edgeRows' gx, gy and squared magnitude
+            return 2 * sizeof(int16_t) * (rowLen + 2 * channels) + 3 * static_cast<size_t>(width) +
+                   (2 * sizeof(int16_t) + sizeof(int32_t)) * rowLen;
+        }
+        if (op.type != OpType::GaussianBlur) return 0;
+
+        int kernelSize = static_cast<int>(op.value);
+        float sigma = op.extra;
+        BlurMode mode = BlurMode::Auto;
+        if (!resolveBlur(kernelSize, sigma, mode)) return 0;
+        if (mode == BlurMode::Separable) {
+            // The ring of kernelSize filtered rows, the padded source row and the accumulator
+            const size_t padded = (static_cast<size_t>(width) + 2 * (kernelSize / 2)) * channels;
+            return sizeof(float) * ((static_cast<size_t>(kernelSize) + 1) * rowLen + padded);
+        }
+        // The padded line of the horizontal passes, or the column sums of
+        // the vertical ones
+        const size_t radius = boxRadiusFor(boxesForGauss(sigma).back() / 2, width);
+        return std::max((width + 2 * radius) * channels, sizeof(uint32_t) * rowLen);
+    }
+
+private:
+    struct Pass {
+        bool flipInput = false;
+        std::vector<Operation> ops;
+        int halo = 0;
+    };
+
+    std::vector<Pass> passes;
+    StripOptions options;
+
+    struct PoolCapacityGuard {
+        const size_t saved = BufferPool::shared().capacityBytes();
+        explicit PoolCapacityGuard(size_t bytes) { BufferPool::shared().setCapacity(bytes); }
+        ~PoolCapacityGuard() { BufferPool::shared().setCapacity(saved); }
+    };
+
+    struct ParallelConfigGuard {
+        const ParallelConfig saved = Parallel::config();
+        ~ParallelConfigGuard() { Parallel::configure(saved); }
+    };
+
+    // One pass per run of ops between vertical flips; back-to-back flips cancel
+    static std::vector<Pass> split(const Pipeline& pipeline) {
+        std::vector<Pass> result(1);
+        for (const Operation& op : pipeline.operations()) {
+            if (op.type == OpType::ReflectVertically) {
+                if (result.back().ops.empty()) {
+                    result.back().flipInput = !result.back().flipInput;
+                    if (!result.back().flipInput && result.size() > 1) result.pop_back();
+                } else {
+                    result.emplace_back();
+                    result.back().flipInput = true;
+                }
+                continue;
+            }
+            result.back().ops.push_back(op);
+            result.back().halo += haloRows(op);
+        }
+        return result;
+    }
+
+    void runPass(const Pass& pass, const std::string& inputPath, const std::string& outputPath, int maxThreads,
+                 StripReport& report) const {
+        PnmReader reader(inputPath);
+        const int width = reader.getWidth();
+        const int height = reader.getHeight();
+        const int channels = reader.getChannels();
+        const PixelFormat format = reader.getPixelFormat();
+
+        const size_t rowBytes = alignedStride(width, channels);
+        size_t perThread = 0;
+        for (const Operation& op : pass.ops) perThread = std::max(perThread, threadScratchBytes(op, width, channels));
+
+        // Give worker scratch at most half the limit, and the strips the rest
+        const int threads = passThreads(perThread, maxThreads);
+        const size_t fixed = threads * perThread + 2 * rowBytes; // Plus the reader and writer lines
+        const long budgetRows = options.memoryLimit > fixed
+            ? static_cast<long>((options.memoryLimit - fixed) / (kBufferCopies * rowBytes)) : 0;
+        const int rows = static_cast<int>(std::min<long>(height, budgetRows - 2L * pass.halo));
+        if (rows < 1) {
+            throw std::invalid_argument("Memory limit too small for " + std::to_string(width) +
+                                        "-pixel rows with " + std::to_string(pass.halo) + " halo rows");
+        }
+
+        PnmWriter writer(outputPath, width, height);
+        for (int y0 = 0; y0 < height; y0 += rows) {
+            const int y1 = std::min(height, y0 + rows);
+            // At the frame edges the strip edge is the frame edge, which the
+            // ops clamp exactly as they would on the whole frame
+            const int top = std::max(0, y0 - pass.halo);
+            const int bottom = std::min(height, y1 + pass.halo);
+
+            Image strip = Image::uninitialized(width, bottom - top, format);
+            if (pass.flipInput) {
+                reader.readRows(height - bottom, height - top, strip);
+                strip.reflectVertically();
+            } else {
+                reader.readRows(top, bottom, strip);
+            }
+
+            applyOps(pass.ops, strip, top, height);
+            writer.writeRows(strip, y0 - top, y1 - y0);
+            report.strips++;
+        }
+        writer.close();
+
+        report.passes++;
+        report.stripRows = rows;
+        report.threads = threads;
+    }
+
+    // Threads for a pass whose workers each need `perThread` scratch bytes:
+    // up to maxThreads, as many as fit their scratch in half the limit.
+    // Resizes the shared pool when that differs from the current one.
+    int passThreads(size_t perThread, int maxThreads) const {
+        int threads = maxThreads;
+        if (perThread > 0) {
+            const size_t fit = options.memoryLimit / 2 / perThread;
+            threads = static_cast<int>(std::clamp<size_t>(fit, 1, static_cast<size_t>(maxThreads)));
+        }
+        if (threads != Parallel::pool()->size()) {
+            ParallelConfig config = Parallel::config();
+            config.threads = threads;
+            Parallel::configure(config);
+        }
+        return threads;
+    }
+
+    // Runs the ops on a strip that holds frame rows [top, top + strip height).
+    // Everything but the vignette is position independent and goes through
+    // the fusing executor; the vignette needs the strip's place in the frame.
+    static void applyOps(const std::vector<Operation>& ops, Image& strip, int top, int frameHeight) {
+        Pipeline run;
+        for (const Operation& op : ops) {
+            if (op.type != OpType::Vignette) {
+                run.add(op);
+                continue;
+            }
+            run.execute(strip);
+            run = Pipeline();
+            strip.addVignetteEffect(op.value, top, frameHeight);
+        }
+        run.execute(strip);
+    }
+};
+
+#endif // STRIP_PROCESSOR_H
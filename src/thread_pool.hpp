@@ -0,0 +1,297 @@
+// thread_pool.hpp
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+
+// Fixed set of worker threads that cooperatively run parallel-for jobs.
+// Several callers (e.g. Crow request threads) may submit jobs at once; each
+// caller also works on its own job, so progress never depends on a free worker.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads) {
+        // The submitting thread is the extra worker
+        for (int i = 1; i < threads; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    // True on a pool worker; nested parallel-fors run inline there
+    static bool onWorkerThread() { return insideWorker(); }
+
+    // Runs fn(i) for every i in [0, count) and returns when all are done.
+    // The first exception thrown by any index is rethrown here.
+    void parallelFor(int count, const std::function<void(int)>& fn) {
+        if (count <= 0) return;
+        if (count == 1 || workers.empty() || insideWorker()) {
+            for (int i = 0; i < count; i++) fn(i);
+            return;
+        }
+
+        auto job = std::make_shared<Job>(fn, count);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(job);
+        }
+        wake.notify_all();
+
+        job->run();
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&] { return job->done == job->count; });
+        if (job->error) std::rethrow_exception(job->error);
+    }
+
+private:
+    struct Job {
+        Job(const std::function<void(int)>& fn, int count) : fn(fn), count(count) {}
+
+        const std::function<void(int)>& fn;
+        const int count;
+        std::atomic<int> next{0};
+        int done = 0; // guarded by mutex
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable finished;
+
+        // Claims indices until none are left
+        void run() {
+            for (int i = next++; i < count; i = next++) {
+                std::exception_ptr failure;
+                try {
+                    fn(i);
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (failure && !error) error = failure;
+                if (++done == count) finished.notify_all();
+            }
+        }
+
+        bool exhausted() const { return next.load() >= count; }
+    };
+
+    static bool& insideWorker() {
+        thread_local bool inside = false;
+        return inside;
+    }
+
+    void workerLoop() {
+        insideWorker() = true;
+        for (;;) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                job = queue.front();
+                if (job->exhausted()) {
+                    queue.pop_front();
+                    continue;
+                }
+            }
+            job->run();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::shared_ptr<Job>> queue;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+
+// Thrown by Deadline::check() once the deadline has passed
+struct DeadlineExceeded : std::runtime_error {
+    DeadlineExceeded() : std::runtime_error("Deadline exceeded") {}
+};
+
+// Point in time after which the image work of one request is abandoned.
+// While a ScopedDeadline is active on a thread, every parallel-for started
+// there checks it before each band or tile, so a long operation stops at the
+// next band boundary instead of running to completion. Checks may come from
+// any pool thread.
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Deadline(Clock::time_point at) : at(at) {}
+
+    static Deadline after(std::chrono::milliseconds timeout) { return Deadline(Clock::now() + timeout); }
+
+    bool expired() const { return Clock::now() >= at; }
+
+    // Throws DeadlineExceeded once expired, and remembers that it did
+    void check() const {
+        if (!expired()) return;
+        hit.store(true, std::memory_order_relaxed);
+        throw DeadlineExceeded();
+    }
+
+    // True when some check() has thrown: the work it guarded was cut short
+    bool wasHit() const { return hit.load(std::memory_order_relaxed); }
+
+    // Deadline active on this thread, or null
+    static const Deadline* current() { return active(); }
+
+private:
+    friend class ScopedDeadline;
+
+    Clock::time_point at;
+    mutable std::atomic<bool> hit{false};
+
+    static const Deadline*& active() {
+        thread_local const Deadline* deadline = nullptr;
+        return deadline;
+    }
+};
+
+// Makes `deadline` the current one for the scope, restoring the previous one after
+class ScopedDeadline {
+public:
+    explicit ScopedDeadline(const Deadline& deadline) : previous(Deadline::active()) {
+        Deadline::active() = &deadline;
+    }
+    ~ScopedDeadline() { Deadline::active() = previous; }
+
+    ScopedDeadline(const ScopedDeadline&) = delete;
+    ScopedDeadline& operator=(const ScopedDeadline&) = delete;
+
+private:
+    const Deadline* previous;
+};
+
+
+// How Image operations split work. Defaults come from the environment
+// (IMAGE_THREADS, IMAGE_BAND_ROWS) so deployments can tune without a rebuild.
+struct ParallelConfig {
+    int threads = 0;  // 0 = one per hardware thread
+    int bandRows = 0; // Rows per work item, 0 = about four bands per thread
+    size_t minParallelBytes = 64 * 1024; // Smaller images run on the caller
+};
+
+class Parallel {
+public:
+    static ParallelConfig config() {
+        std::lock_guard<std::mutex> lock(state().mutex);
+        return state().config;
+    }
+
+    // Replaces the shared pool. Jobs already running finish on the old one.
+    static void configure(const ParallelConfig& config) {
+        std::lock_guard<std::mutex> lock(state().mutex);
+        state().config = config;
+        state().pool.reset();
+    }
+
+    static std::shared_ptr<ThreadPool> pool() {
+        std::lock_guard<std::mutex> lock(state().mutex);
+        State& s = state();
+        if (!s.pool) {
+            int threads = s.config.threads;
+            if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+            s.pool = std::make_shared<ThreadPool>(std::max(1, threads));
+        }
+        return s.pool;
+    }
+
+    // Calls fn(y0, y1) over row bands covering [0, height). Neighbourhood ops
+    // read a halo outside their band from the source, so they pass minRows to
+    // keep that overlap small relative to the band.
+    static void forRows(int height, size_t bytes, const std::function<void(int, int)>& fn,
+                        int minRows = 1) {
+        if (height <= 0) return;
+
+        const Deadline* deadline = Deadline::current();
+        const ParallelConfig cfg = config();
+        if (bytes < cfg.minParallelBytes || ThreadPool::onWorkerThread()) {
+            if (deadline) deadline->check();
+            fn(0, height);
+            return;
+        }
+
+        std::shared_ptr<ThreadPool> workers = pool();
+        int rows = cfg.bandRows;
+        if (rows <= 0) rows = (height + workers->size() * 4 - 1) / (workers->size() * 4);
+        rows = std::max(rows, minRows);
+
+        const int bands = (height + rows - 1) / rows;
+        workers->parallelFor(bands, [&](int band) {
+            if (deadline) deadline->check();
+            fn(band * rows, std::min(height, (band + 1) * rows));
+        });
+    }
+
+    // Same for column tiles [x0, x1), used by passes that run down columns
+    static void forColumns(int width, size_t bytes, const std::function<void(int, int)>& fn) {
+        if (width <= 0) return;
+
+        const Deadline* deadline = Deadline::current();
+        const ParallelConfig cfg = config();
+        if (bytes < cfg.minParallelBytes || ThreadPool::onWorkerThread()) {
+            if (deadline) deadline->check();
+            fn(0, width);
+            return;
+        }
+
+        std::shared_ptr<ThreadPool> workers = pool();
+        // At least a cache line of pixels per tile so tiles do not share lines
+        const int cols = std::max(64, (width + workers->size() * 4 - 1) / (workers->size() * 4));
+        const int tiles = (width + cols - 1) / cols;
+        workers->parallelFor(tiles, [&](int tile) {
+            if (deadline) deadline->check();
+            fn(tile * cols, std::min(width, (tile + 1) * cols));
+        });
+    }
+
+private:
+    struct State {
+        std::mutex mutex;
+        ParallelConfig config = fromEnvironment();
+        std::shared_ptr<ThreadPool> pool;
+    };
+
+    static State& state() {
+        static State s;
+        return s;
+    }
+
+    static ParallelConfig fromEnvironment() {
+        ParallelConfig cfg;
+        if (const char* threads = std::getenv("IMAGE_THREADS")) cfg.threads = std::atoi(threads);
+        if (const char* rows = std::getenv("IMAGE_BAND_ROWS")) cfg.bandRows = std::atoi(rows);
+        return cfg;
+    }
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,126 @@
+// Checks that Pipeline::execute(), which fuses and reorders work, gives the
+// same bytes as running each operation on its own with Operation::applyTo():
+// random chains on 1-4 channel images, on the caller's thread and split into
+// small bands across a pool. Point and row operations, epilogues after blurs
+// and edge detection, whole-frame operations and flip pairs must match
+// exactly. Adjacent colour operations are composed into one matrix and may
+// differ by the intermediate truncations, so chains of those alone are held
+// to a small tolerance instead.
+//
+//   g++ -std=c++17 -O2 tests/pipeline_fusion_test.cpp -o pipeline_test -I. -pthread
+//   ./pipeline_test    # exit code 1 on any mismatch
+#include "src/pipeline.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+
+int failures = 0;
+
+Image randomImage(std::mt19937& random, int channels) {
+    const int width = 1 + random() % 48, height = 1 + random() % 48;
+    Image image(width, height, channels);
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = image.row(y);
+        for (int i = 0; i < width * channels; i++) row[i] = static_cast<uint8_t>(random());
+    }
+    return image;
+}
+
+// Any operation but a colour one, with parameters in its usual range
+Operation randomOperation(std::mt19937& random) {
+    auto pick = [&](std::initializer_list<float> values) { return *(values.begin() + random() % values.size()); };
+    switch (random() % 15) {
+        case 0: return {OpType::Brightness, static_cast<float>(static_cast<int>(random() % 201) - 100)};
+        case 1: return {OpType::Contrast, pick({0.3f, 0.8f, 1.2f, 1.9f, 3.0f})};
+        case 2: return {OpType::Invert};
+        case 3: return {OpType::Compress, pick({0.1f, 0.5f, 0.9f})};
+        case 4: return {OpType::GaussianBlur, static_cast<float>(3 + random() % 24), pick({0.0f, 1.5f, 4.0f})};
+        case 5: return {OpType::Vignette, pick({0.2f, 0.6f, 1.0f})};
+        case 6: return {OpType::ReflectHorizontally};
+        case 7: return {OpType::ReflectVertically};
+        case 8: return {OpType::EdgeDetect, static_cast<float>(random() % 8)};
+        case 9: return {OpType::Canny, pick({0.0f, 30.0f}), pick({0.0f, 90.0f})};
+        case 10: return {OpType::AutoLevels, pick({0.0f, 0.01f})};
+        case 11: return {OpType::Equalize};
+        case 12: return {OpType::Clahe, pick({0.0f, 3.0f}), pick({0.0f, 2.0f})};
+        case 13: return {OpType::ReflectHorizontally}; // Flips twice as often, so pairs turn up
+        default: return {OpType::ReflectVertically};
+    }
+}
+
+Operation randomColourOperation(std::mt19937& random) {
+    switch (random() % 4) {
+        case 0: return {OpType::Saturation, static_cast<float>(random() % 30) / 10.0f};
+        case 1: return {OpType::Sepia};
+        case 2: return {OpType::HueRotate, static_cast<float>(random() % 360)};
+        default: return {OpType::Grayscale};
+    }
+}
+
+// Runs `ops` fused and one by one on copies of `image`; reports the chain
+// when the results differ by more than `tolerance`
+void compare(const std::string& mode, const Image& image, const std::vector<Operation>& ops, int tolerance) {
+    const Pipeline pipeline(ops);
+    Image fused = image, sequential = image;
+    pipeline.execute(fused);
+    for (const Operation& op : ops) op.applyTo(sequential);
+
+    int worst = -1; // -1: the shapes differ
+    if (fused.getWidth() == sequential.getWidth() && fused.getHeight() == sequential.getHeight() &&
+        fused.getChannels() == sequential.getChannels()) {
+        worst = 0;
+        for (int y = 0; y < fused.getHeight(); y++) {
+            const uint8_t* a = fused.row(y);
+            const uint8_t* b = sequential.row(y);
+            for (int i = 0; i < fused.getWidth() * fused.getChannels(); i++) {
+                worst = std::max(worst, std::abs(a[i] - b[i]));
+            }
+        }
+    }
+    if (worst >= 0 && worst <= tolerance) return;
+    if (failures++ < 20) {
+        std::printf("MISMATCH %s %s on %dx%dx%d: %s\n", mode.c_str(), pipeline.toString().c_str(), image.getWidth(),
+                    image.getHeight(), image.getChannels(),
+                    worst < 0 ? "shape differs" : ("differs by " + std::to_string(worst)).c_str());
+    }
+}
+
+void run(const std::string& mode) {
+    std::mt19937 random(2024);
+    for (int iteration = 0; iteration < 3000; iteration++) {
+        const Image image = randomImage(random, 1 + iteration % 4);
+        std::vector<Operation> ops;
+        const int length = 1 + random() % 6;
+        for (int i = 0; i < length; i++) ops.push_back(randomOperation(random));
+        // At most one colour operation, so nothing is composed
+        if (random() % 2) ops.insert(ops.begin() + random() % (ops.size() + 1), randomColourOperation(random));
+        compare(mode, image, ops, 0);
+    }
+    for (int iteration = 0; iteration < 1000; iteration++) {
+        const Image image = randomImage(random, 3 + iteration % 2);
+        std::vector<Operation> ops;
+        const int length = 2 + random() % 3;
+        for (int i = 0; i < length; i++) ops.push_back(randomColourOperation(random));
+        compare(mode + " colour", image, ops, 2 * (length - 1)); // Up to 2 levels per dropped truncation
+    }
+}
+
+int main() {
+    ParallelConfig serial;
+    serial.threads = 1;
+    Parallel::configure(serial);
+    run("serial");
+
+    ParallelConfig banded;
+    banded.threads = 6;
+    banded.bandRows = 5;
+    banded.minParallelBytes = 0;
+    Parallel::configure(banded);
+    run("banded");
+
+    std::printf("%d mismatch(es)\n", failures);
+    return failures ? 1 : 0;
+}